@@ -0,0 +1,236 @@
+#include "ltc_bench.h"
+#include "ltc_common.h"
+#include "ltc_convert.h"
+#include "ltc_tod.h"
+#include "ltc_ntp.h"
+#include "ltc_seqlock.h"
+#include "ltc_correction.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FRAME_SAMPLES 1920   // One 25 fps frame at 48 kHz
+#define BENCH_ITERATIONS 20000
+#define BENCH_SEQLOCK_READS 5000000
+
+static int64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Time one conversion kernel over BENCH_ITERATIONS frames, returns ns per frame
+static double bench_convert(convert_s8_fn fn, int16_t *dst, const int8_t *src) {
+    // Warm up caches and branch predictors first
+    for (int i = 0; i < 100; i++) {
+        fn(dst, src, BENCH_FRAME_SAMPLES);
+    }
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fn(dst, src, BENCH_FRAME_SAMPLES);
+        __asm__ __volatile__("" : : "r"(dst) : "memory"); // Keep the work from being elided
+    }
+    return (double)(bench_now_ns() - start) / BENCH_ITERATIONS;
+}
+
+static int bench_convert_kernels(void) {
+    static int8_t src[BENCH_FRAME_SAMPLES];
+    static int16_t expected[BENCH_FRAME_SAMPLES];
+    static int16_t dst[BENCH_FRAME_SAMPLES];
+    int failures = 0;
+
+    // Cover every int8 value, including -128 which exercises the clamp
+    for (int i = 0; i < BENCH_FRAME_SAMPLES; i++) {
+        src[i] = (int8_t)(i * 37);
+    }
+    convert_s8_reference(expected, src, BENCH_FRAME_SAMPLES);
+
+    printf("int8 -> int16 conversion (%d samples/frame, %d frames)\n",
+           BENCH_FRAME_SAMPLES, BENCH_ITERATIONS);
+    double ref_ns = bench_convert(convert_s8_reference, dst, src);
+    printf("  %-10s %10.1f ns/frame\n", "reference", ref_ns);
+
+    const convert_kernel_t *selected = convert_select();
+    for (int k = 0; k < NUM_CONVERT_KERNELS; k++) {
+        const convert_kernel_t *kernel = &convert_kernels[k];
+        if (!kernel->supported()) {
+            printf("  %-10s not supported on this CPU\n", kernel->name);
+            continue;
+        }
+        memset(dst, 0, sizeof(dst));
+        kernel->fn(dst, src, BENCH_FRAME_SAMPLES);
+        int identical = memcmp(dst, expected, sizeof(dst)) == 0;
+        if (!identical) failures++;
+
+        double ns = bench_convert(kernel->fn, dst, src);
+        printf("  %-10s %10.1f ns/frame  %5.1fx  %s%s\n", kernel->name, ns, ref_ns / ns,
+               identical ? "bit-identical" : "MISMATCH",
+               kernel == selected ? "  (selected)" : "");
+    }
+    return failures;
+}
+
+// Compare the per-frame cost of localtime() with the cached day anchor,
+// and check both agree over a span that crosses midnight
+static int bench_time_of_day(void) {
+    const int frames = BENCH_ITERATIONS * 10;
+    const int64_t step_us = 40000; // 25 fps
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t start_us = (int64_t)ts.tv_sec * MICROSECONDS_PER_SECOND;
+    volatile int sink = 0;
+    int failures = 0;
+
+    printf("Time of day split (%d frames at 25 fps)\n", frames);
+
+    int64_t t0 = bench_now_ns();
+    for (int i = 0; i < frames; i++) {
+        time_t whole = (time_t)((start_us + i * step_us) / MICROSECONDS_PER_SECOND);
+        struct tm *tm = localtime(&whole);
+        sink += tm->tm_sec;
+    }
+    double localtime_ns = (double)(bench_now_ns() - t0) / frames;
+
+    tod_anchor_t anchor = {0};
+    SMPTETimecode tc;
+    t0 = bench_now_ns();
+    for (int i = 0; i < frames; i++) {
+        tod_split(&anchor, (start_us + i * step_us) / MICROSECONDS_PER_SECOND, &tc);
+        sink += tc.secs;
+    }
+    double anchor_ns = (double)(bench_now_ns() - t0) / frames;
+
+    // Walk two days in 17 minute steps (crossing midnight and any DST change)
+    for (int64_t t = start_us / MICROSECONDS_PER_SECOND; t < start_us / MICROSECONDS_PER_SECOND + 2 * 86400; t += 1021) {
+        time_t whole = (time_t)t;
+        struct tm tm;
+        localtime_r(&whole, &tm);
+        tod_split(&anchor, t, &tc);
+        if (tc.hours != tm.tm_hour || tc.mins != tm.tm_min || tc.secs != tm.tm_sec || tc.days != tm.tm_mday) {
+            failures++;
+        }
+    }
+
+    printf("  %-10s %10.1f ns/frame\n", "localtime", localtime_ns);
+    printf("  %-10s %10.1f ns/frame  %5.1fx  %s\n", "anchor", anchor_ns, localtime_ns / anchor_ns,
+           failures == 0 ? "matches localtime" : "MISMATCH");
+    return failures;
+}
+
+// The original per-frame curve evaluation, kept for comparison
+static int64_t bench_correction_direct(const correction_curve_t *c, int64_t frame_us, long tv_nsec) {
+    double x = (double)tv_nsec / 1000000000.0;
+    double offset_frames = c->max_frames - (1.0 - exp(-c->decay * x)) * (c->max_frames - c->min_frames);
+    offset_frames += c->phase * sin(2 * M_PI * x);
+    offset_frames += c->quadratic * (1.0 - x * x);
+    return (int64_t)(frame_us * offset_frames);
+}
+
+static int bench_correction_table(void) {
+    const framerate_spec_t *rate = parse_rate("25");
+    rate_plan_t plan;
+    static correction_table_t table;
+    const int frames = 200000;
+    int64_t sink = 0, max_err = 0;
+
+    rate_plan_init(&plan, rate, 48000);
+    correction_build(&table, &correction_curve, &plan);
+    printf("Adaptive correction curve (%d frames at %s fps)\n", frames, rate->name);
+
+    int64_t t0 = bench_now_ns();
+    for (int i = 0; i < frames; i++) {
+        sink += bench_correction_direct(&correction_curve, plan.us_per_frame, (i * 40000007L) % 1000000000L);
+    }
+    double direct_ns = (double)(bench_now_ns() - t0) / frames;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < frames; i++) {
+        sink += correction_lookup(&table, (i * 40000007L) % 1000000000L);
+    }
+    double table_ns = (double)(bench_now_ns() - t0) / frames;
+    __asm__ __volatile__("" : : "r"(sink));
+
+    for (long ns = 0; ns < 1000000000L; ns += 9973) {
+        int64_t err = correction_lookup(&table, ns) - bench_correction_direct(&correction_curve, plan.us_per_frame, ns);
+        if (err < 0) err = -err;
+        if (err > max_err) max_err = err;
+    }
+
+    printf("  %-10s %10.1f ns/frame\n", "exp/sin", direct_ns);
+    printf("  %-10s %10.1f ns/frame  %5.1fx  max deviation %" PRId64 " us\n", "table", table_ns,
+           direct_ns / table_ns, max_err);
+    return 0;
+}
+
+typedef struct {
+    seqlock_t lock;
+    volatile int stop;
+    uint64_t publishes;
+} bench_seqlock_t;
+
+// Publish records whose fields are all derived from one counter, so any
+// mix of two publishes is detectable on the reader side
+static void *bench_seqlock_writer(void *arg) {
+    bench_seqlock_t *b = (bench_seqlock_t*)arg;
+    clock_correction_t c;
+    uint32_t k = 0;
+    while (!b->stop) {
+        k++;
+        c.base_us = (int64_t)k * 1000003;
+        c.base_offset_us = -(int64_t)k;
+        c.freq_ppb = (int32_t)(k * 7);
+        c.phase_us = -(int32_t)k;
+        c.slew_s = ~k;
+        c.generation = k;
+        seqlock_write(&b->lock, &c, sizeof(c));
+    }
+    b->publishes = k;
+    return NULL;
+}
+
+static int bench_correction_seqlock(void) {
+    static bench_seqlock_t b;
+    clock_correction_t c = {0};
+    pthread_t writer;
+    uint64_t ok = 0, busy = 0, torn = 0;
+
+    printf("NTP correction seqlock (%d snapshots against a continuous writer)\n", BENCH_SEQLOCK_READS);
+    if (pthread_create(&writer, NULL, bench_seqlock_writer, &b) != 0) {
+        printf("  could not start writer thread\n");
+        return 1;
+    }
+
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_SEQLOCK_READS; i++) {
+        if (seqlock_try_read(&b.lock, &c, sizeof(c)) != 0) {
+            busy++;
+            continue;
+        }
+        ok++;
+        uint32_t k = c.generation;
+        if (c.base_us != (int64_t)k * 1000003 || c.base_offset_us != -(int64_t)k ||
+            c.freq_ppb != (int32_t)(k * 7) || c.phase_us != -(int32_t)k ||
+            (k != 0 && c.slew_s != ~k)) {
+            torn++;
+        }
+    }
+    double read_ns = (double)(bench_now_ns() - start) / BENCH_SEQLOCK_READS;
+    b.stop = 1;
+    pthread_join(writer, NULL);
+
+    printf("  %-10s %10.1f ns/read   %" PRIu64 " consistent, %" PRIu64 " skipped mid-write, %" PRIu64 " publishes\n",
+           "try_read", read_ns, ok, busy, b.publishes);
+    printf("  %-10s %10" PRIu64 "  %s\n", "torn reads", torn, torn == 0 ? "ok" : "INCONSISTENT");
+    return torn == 0 ? 0 : 1;
+}
+
+int run_benchmarks(void) {
+    int failures = 0;
+    failures += bench_convert_kernels();
+    failures += bench_time_of_day();
+    failures += bench_correction_table();
+    failures += bench_correction_seqlock();
+    return failures == 0 ? 0 : 1;
+}
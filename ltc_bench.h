@@ -0,0 +1,8 @@
+#ifndef LTC_BENCH_H
+#define LTC_BENCH_H
+
+// Run the built-in microbenchmarks and print results to stdout.
+// Returns 0 if every kernel produced output identical to its reference.
+int run_benchmarks(void);
+
+#endif // LTC_BENCH_H
@@ -0,0 +1,360 @@
+#include "ltc_calibrate.h"
+#include "ltc_ntp.h"
+#include "ltc_tod.h"
+#include "ltc_output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+// Global variables
+char calibration_dir[256] = CALIBRATION_DEFAULT_DIR;
+int calibration_frames = CALIBRATION_DEFAULT_FRAMES;
+
+// Generated frames are remembered as day frame -> system clock bucket. Each
+// slot packs a valid bit, 12 bits of the day frame above the slot index and
+// the correction bucket, so it fits one lock-free 32-bit atomic.
+#define SLOT_VALID (1u << 24)
+#define SLOT_TAG(day_frame) ((unsigned)((day_frame) / CALIBRATION_SLOTS) & 0xFFFu)
+
+typedef struct {
+    snd_pcm_t *pcm;
+    const rate_plan_t *plan;
+    LTCDecoder *decoder;
+    pthread_t thread;
+    int64_t sum_us[CALIBRATION_BINS];
+    int64_t count[CALIBRATION_BINS];
+    double sum_sq;
+    int frames;
+} calibration_state_t;
+
+static calibration_state_t cal;
+static atomic_uint generated[CALIBRATION_SLOTS];
+
+// One profile per card, frame rate and sample rate, as the offsets depend
+// on all three
+static void calibration_path(const char *card, const rate_plan_t *plan, unsigned int sample_rate,
+                             char *path, size_t n) {
+    char key[192], file[192];
+    snprintf(key, sizeof(key), "%s-%s-%u", card, plan->spec->name, sample_rate);
+    size_t i = 0;
+    for (; key[i] && i < sizeof(file) - 1; i++) {
+        char c = key[i];
+        int keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                   (c >= '0' && c <= '9') || c == '-' || c == '_';
+        file[i] = keep ? c : '_';
+    }
+    file[i] = 0;
+    snprintf(path, n, "%s/%s.cal", calibration_dir, file);
+}
+
+int calibration_load(output_t *out, const rate_plan_t *plan, correction_table_t *table) {
+    char card[128], path[512], line[MAX_LINE * 4], framerate[32] = "";
+    calibration_profile_t profile;
+    memset(&profile, 0, sizeof(profile));
+
+    output_card_name(out, card, sizeof(card));
+    calibration_path(card, plan, out->rate, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char *eq = strchr(line, '=');
+        if (!eq) continue;
+        *eq = 0;
+        char *val = eq + 1;
+        if (strcmp(line, "offsets-us") == 0) {
+            char *p = val, *end;
+            while (profile.bins < CALIBRATION_BINS) {
+                long v = strtol(p, &end, 10);
+                if (end == p) break;
+                profile.offset_us[profile.bins++] = (int32_t)v;
+                p = (*end == ',') ? end + 1 : end;
+            }
+        } else if (strcmp(line, "framerate") == 0) {
+            val[strcspn(val, "\r\n")] = 0;
+            snprintf(framerate, sizeof(framerate), "%s", val);
+        } else if (strcmp(line, "sample-rate") == 0) {
+            profile.sample_rate = (unsigned int)strtoul(val, NULL, 10);
+        } else if (strcmp(line, "frames") == 0) {
+            profile.frames = atoi(val);
+        } else if (strcmp(line, "jitter-us") == 0) {
+            profile.jitter_us = atoi(val);
+        }
+    }
+    fclose(f);
+
+    if (profile.bins < 1) {
+        fprintf(stderr, "Warning: Ignoring empty calibration profile %s\n", path);
+        return -1;
+    }
+    // The name says which rates it is for, but the file may have been copied
+    if (strcmp(framerate, plan->spec->name) != 0 || profile.sample_rate != out->rate) {
+        fprintf(stderr, "Warning: Ignoring calibration profile %s, measured at %s fps and %u Hz, not %s fps and %u Hz\n",
+                path, framerate[0] ? framerate : "?", profile.sample_rate, plan->spec->name, out->rate);
+        return -1;
+    }
+
+    // Interpolate linearly between bin centres, wrapping around the second
+    int64_t sum = 0;
+    for (int i = 0; i < CORRECTION_BUCKETS; i++) {
+        double x = (i + 0.5) * profile.bins / CORRECTION_BUCKETS - 0.5;
+        int b0 = (int)floor(x);
+        double w = x - b0;
+        int32_t v0 = profile.offset_us[(b0 + profile.bins) % profile.bins];
+        int32_t v1 = profile.offset_us[(b0 + 1) % profile.bins];
+        table->offset_us[i] = (int32_t)lrint(v0 + w * (v1 - v0));
+        sum += table->offset_us[i];
+    }
+    table->mean_us = (int32_t)(sum / CORRECTION_BUCKETS);
+
+    fprintf(stderr, "Loaded calibration profile %s (%d frames, mean offset %d us, jitter %d us)\n",
+            path, profile.frames, table->mean_us, profile.jitter_us);
+    return 0;
+}
+
+void calibration_note_frame(const SMPTETimecode *tc, const rate_plan_t *plan, long tv_nsec) {
+    int64_t day_frame = timecode_to_frames(tc, plan);
+    unsigned int entry = SLOT_VALID | (SLOT_TAG(day_frame) << 12) |
+                         (unsigned int)(tv_nsec >> CORRECTION_BUCKET_SHIFT);
+    atomic_store_explicit(&generated[day_frame % CALIBRATION_SLOTS], entry, memory_order_relaxed);
+}
+
+// Compare one decoded frame's on-wire time with the start of the frame it names
+static void calibration_measure(const LTCFrameExt *frame, int64_t wire_us, tod_anchor_t *anchor) {
+    const rate_plan_t *plan = cal.plan;
+    SMPTETimecode label, wire;
+    ltc_frame_to_time(&label, (LTCFrame*)&frame->ltc, 0);
+
+    // Frames 0-2 share one label in drop-frame minutes, so their start is ambiguous
+    if (plan->spec->drop_frame && label.mins % 10 != 0 && label.frame <= 2) {
+        return;
+    }
+
+    int64_t day_frame = timecode_to_frames(&label, plan);
+    unsigned int entry = atomic_load_explicit(&generated[day_frame % CALIBRATION_SLOTS], memory_order_relaxed);
+    if (!(entry & SLOT_VALID) || ((entry >> 12) & 0xFFFu) != SLOT_TAG(day_frame)) {
+        return; // Not a frame this run generated recently
+    }
+    int bucket = (int)(entry & 0xFFFu);
+
+    tod_split(anchor, wire_us / MICROSECONDS_PER_SECOND, &wire);
+    int64_t wire_tod_us = (((int64_t)wire.hours * 60 + wire.mins) * 60 + wire.secs) * MICROSECONDS_PER_SECOND +
+                          wire_us % MICROSECONDS_PER_SECOND;
+    int64_t label_start_us = ((int64_t)label.frame * plan->ltc_den * MICROSECONDS_PER_SECOND +
+                              plan->ltc_num - 1) / plan->ltc_num;
+    int64_t label_tod_us = (((int64_t)label.hours * 60 + label.mins) * 60 + label.secs) * MICROSECONDS_PER_SECOND +
+                           label_start_us;
+
+    int64_t day_us = (int64_t)TOD_SECONDS_PER_DAY * MICROSECONDS_PER_SECOND;
+    int64_t offset_us = wire_tod_us - label_tod_us;
+    if (offset_us > day_us / 2) offset_us -= day_us;
+    if (offset_us < -day_us / 2) offset_us += day_us;
+    if (offset_us > MICROSECONDS_PER_SECOND || offset_us < -MICROSECONDS_PER_SECOND) {
+        return; // Misdecode or a frame from before a clock step
+    }
+
+    int bin = bucket * CALIBRATION_BINS / CORRECTION_BUCKETS;
+    cal.sum_us[bin] += offset_us;
+    cal.count[bin]++;
+    cal.sum_sq += (double)offset_us * offset_us;
+    cal.frames++;
+}
+
+static void* calibration_capture_thread(void *arg) {
+    int16_t buf[CALIBRATION_CHUNK];
+    snd_pcm_status_t *status;
+    snd_pcm_status_alloca(&status);
+    tod_anchor_t anchor;
+    memset(&anchor, 0, sizeof(anchor));
+    uint64_t read_total = 0;
+    int decoded = 0;
+    int last_report = 0;
+
+    while (running && cal.frames < calibration_frames) {
+        snd_pcm_sframes_t n = snd_pcm_readi(cal.pcm, buf, CALIBRATION_CHUNK);
+        if (n < 0) {
+            snd_pcm_recover(cal.pcm, (int)n, 1);
+            continue;
+        }
+
+        // Time of the newest captured sample: the status timestamp, less the
+        // samples still waiting in the capture buffer
+        struct timespec ts = {0, 0};
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_status(cal.pcm, status) >= 0) {
+            snd_pcm_status_get_htstamp(status, &ts);
+            delay = snd_pcm_status_get_delay(status);
+        }
+        if (ts.tv_sec == 0 && ts.tv_nsec == 0) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+        }
+        int64_t newest_us = (int64_t)ts.tv_sec * MICROSECONDS_PER_SECOND + ts.tv_nsec / NANOSECONDS_PER_MICROSECOND;
+        if (use_ntp) {
+            newest_us += ntp_applied_offset();
+        }
+
+        ltc_decoder_write_s16(cal.decoder, buf, (size_t)n, (ltc_off_t)read_total);
+        read_total += (uint64_t)n;
+        int64_t newest_index = (int64_t)read_total + delay - 1;
+
+        LTCFrameExt frame;
+        while (ltc_decoder_read(cal.decoder, &frame)) {
+            if (++decoded <= CALIBRATION_WARMUP_FRAMES) continue;
+            int64_t wire_us = newest_us - (newest_index - frame.off_start) * MICROSECONDS_PER_SECOND /
+                              (int64_t)cal.plan->sample_rate;
+            calibration_measure(&frame, wire_us, &anchor);
+        }
+
+        if (cal.frames - last_report >= 500) {
+            last_report = cal.frames;
+            fprintf(stderr, "Calibration: %d/%d frames measured\n", cal.frames, calibration_frames);
+        }
+    }
+
+    running = 0; // Stop the generator
+    return NULL;
+}
+
+int calibration_start(const char *capture_device, const rate_plan_t *plan) {
+    int err;
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_sw_params_t *sw_params;
+    snd_pcm_hw_params_alloca(&hw_params);
+    snd_pcm_sw_params_alloca(&sw_params);
+
+    memset(&cal, 0, sizeof(cal));
+    for (int i = 0; i < CALIBRATION_SLOTS; i++) {
+        atomic_init(&generated[i], 0);
+    }
+    cal.plan = plan;
+
+    if ((err = snd_pcm_open(&cal.pcm, capture_device, SND_PCM_STREAM_CAPTURE, 0)) < 0) {
+        fprintf(stderr, "Failed to open capture device '%s': %s\n", capture_device, snd_strerror(err));
+        return -1;
+    }
+
+    unsigned int rate = plan->sample_rate;
+    snd_pcm_uframes_t buffer_size = (snd_pcm_uframes_t)cadence_max(&plan->cadence) * 4;
+    snd_pcm_uframes_t period_size = CALIBRATION_CHUNK;
+    int dir = 0;
+    if ((err = snd_pcm_hw_params_any(cal.pcm, hw_params)) < 0 ||
+        (err = snd_pcm_hw_params_set_access(cal.pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0 ||
+        (err = snd_pcm_hw_params_set_format(cal.pcm, hw_params, SND_PCM_FORMAT_S16_LE)) < 0 ||
+        (err = snd_pcm_hw_params_set_channels(cal.pcm, hw_params, CHANNELS)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate_near(cal.pcm, hw_params, &rate, 0)) < 0 ||
+        (err = snd_pcm_hw_params_set_buffer_size_near(cal.pcm, hw_params, &buffer_size)) < 0 ||
+        (err = snd_pcm_hw_params_set_period_size_near(cal.pcm, hw_params, &period_size, &dir)) < 0 ||
+        (err = snd_pcm_hw_params(cal.pcm, hw_params)) < 0) {
+        fprintf(stderr, "Cannot configure capture device: %s\n", snd_strerror(err));
+        snd_pcm_close(cal.pcm);
+        return -1;
+    }
+    if (rate != plan->sample_rate) {
+        fprintf(stderr, "Capture device does not support %u Hz\n", plan->sample_rate);
+        snd_pcm_close(cal.pcm);
+        return -1;
+    }
+
+    // Capture timestamps on the system clock, like the playback side
+    if (snd_pcm_sw_params_current(cal.pcm, sw_params) < 0 ||
+        snd_pcm_sw_params_set_tstamp_mode(cal.pcm, sw_params, SND_PCM_TSTAMP_ENABLE) < 0 ||
+        snd_pcm_sw_params_set_tstamp_type(cal.pcm, sw_params, SND_PCM_TSTAMP_TYPE_GETTIMEOFDAY) < 0 ||
+        snd_pcm_sw_params(cal.pcm, sw_params) < 0) {
+        fprintf(stderr, "Warning: Capture timestamps unavailable, using the system clock after each read\n");
+    }
+
+    cal.decoder = ltc_decoder_create(plan->cadence.base, 32);
+    if (!cal.decoder) {
+        fprintf(stderr, "Failed to create LTC decoder\n");
+        snd_pcm_close(cal.pcm);
+        return -1;
+    }
+
+    if (pthread_create(&cal.thread, NULL, calibration_capture_thread, NULL) != 0) {
+        fprintf(stderr, "Failed to start capture thread\n");
+        ltc_decoder_free(cal.decoder);
+        snd_pcm_close(cal.pcm);
+        return -1;
+    }
+
+    fprintf(stderr, "Calibrating against capture device %s over %d frames\n", capture_device, calibration_frames);
+    return 0;
+}
+
+int calibration_finish(output_t *playback) {
+    calibration_profile_t profile;
+    char path[512];
+
+    pthread_join(cal.thread, NULL);
+    ltc_decoder_free(cal.decoder);
+    snd_pcm_close(cal.pcm);
+
+    if (cal.frames == 0) {
+        fprintf(stderr, "Calibration failed: no LTC decoded on the capture device\n");
+        return -1;
+    }
+
+    memset(&profile, 0, sizeof(profile));
+    output_card_name(playback, profile.card, sizeof(profile.card));
+    profile.sample_rate = playback->rate;
+    profile.bins = CALIBRATION_BINS;
+    profile.frames = cal.frames;
+
+    // Empty bins take the value of the nearest measured bins either side
+    int64_t total = 0;
+    for (int b = 0; b < CALIBRATION_BINS; b++) {
+        total += cal.sum_us[b];
+    }
+    double mean = (double)total / cal.frames;
+    profile.jitter_us = (int32_t)lrint(sqrt(fmax(0.0, cal.sum_sq / cal.frames - mean * mean)));
+    for (int b = 0; b < CALIBRATION_BINS; b++) {
+        if (cal.count[b] > 0) {
+            profile.offset_us[b] = (int32_t)(cal.sum_us[b] / cal.count[b]);
+            continue;
+        }
+        int lo = -1, hi = -1;
+        for (int d = 1; d < CALIBRATION_BINS && (lo < 0 || hi < 0); d++) {
+            if (lo < 0 && cal.count[(b - d + CALIBRATION_BINS) % CALIBRATION_BINS] > 0) lo = d;
+            if (hi < 0 && cal.count[(b + d) % CALIBRATION_BINS] > 0) hi = d;
+        }
+        int lb = (b - lo + CALIBRATION_BINS) % CALIBRATION_BINS, hb = (b + hi) % CALIBRATION_BINS;
+        double lv = (double)cal.sum_us[lb] / cal.count[lb], hv = (double)cal.sum_us[hb] / cal.count[hb];
+        profile.offset_us[b] = (int32_t)lrint(lv + (hv - lv) * lo / (lo + hi));
+    }
+
+    if (mkdir(calibration_dir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create calibration directory %s: %s\n", calibration_dir, strerror(errno));
+        return -1;
+    }
+    calibration_path(profile.card, cal.plan, profile.sample_rate, path, sizeof(path));
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write calibration profile %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "# ltc_timecode_pi calibration profile\n");
+    fprintf(f, "# Offset between on-wire and nominal frame start, by position within the second\n");
+    fprintf(f, "card=%s\n", profile.card);
+    fprintf(f, "framerate=%s\n", cal.plan->spec->name);
+    fprintf(f, "sample-rate=%u\n", profile.sample_rate);
+    fprintf(f, "frames=%d\n", profile.frames);
+    fprintf(f, "jitter-us=%d\n", profile.jitter_us);
+    fprintf(f, "offsets-us=");
+    for (int b = 0; b < profile.bins; b++) {
+        fprintf(f, "%s%d", b ? "," : "", profile.offset_us[b]);
+    }
+    fprintf(f, "\n");
+    fclose(f);
+
+    printf("Calibration of '%s': %d frames, mean offset %.0f us (%.2f frames), jitter %d us\n",
+           profile.card, profile.frames, mean, mean / cal.plan->us_per_frame, profile.jitter_us);
+    printf("Profile written to %s\n", path);
+    return 0;
+}
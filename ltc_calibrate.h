@@ -0,0 +1,44 @@
+#ifndef LTC_CALIBRATE_H
+#define LTC_CALIBRATE_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+#include "ltc_correction.h"
+
+#define CALIBRATION_DEFAULT_DIR "/var/lib/ltc_timecode_pi"
+#define CALIBRATION_DEFAULT_FRAMES 5000
+#define CALIBRATION_WARMUP_FRAMES 50    // Decoded frames ignored while the streams settle
+#define CALIBRATION_BINS 50             // Profile resolution over one second (20 ms bins)
+#define CALIBRATION_SLOTS 4096          // Recently generated frames remembered for matching
+#define CALIBRATION_CHUNK 256           // Capture read size in samples
+
+// Measured processing offset for one output device. Each bin holds the mean
+// difference, in microseconds, between the time a frame was heard and the
+// start of the frame its timecode names, for frames generated while the
+// system clock was in that part of the second.
+typedef struct {
+    char card[128];
+    unsigned int sample_rate;
+    int bins;
+    int32_t offset_us[CALIBRATION_BINS];
+    int32_t jitter_us;        // Standard deviation of the individual measurements
+    int frames;               // Frames the profile was measured over
+} calibration_profile_t;
+
+extern char calibration_dir[256];
+extern int calibration_frames;
+
+// Load the profile for the output into the correction table. Profiles are
+// keyed by output_card_name(), the frame rate and the sample rate. Returns 0
+// if a profile was found, -1 to keep the configured curve.
+int calibration_load(output_t *out, const rate_plan_t *plan, correction_table_t *table);
+
+// Loopback calibration. calibration_start opens the capture device and starts
+// decoding; the generator then records every frame it produces with
+// calibration_note_frame and stops when running is cleared by the capture
+// thread. calibration_finish writes the profile.
+int calibration_start(const char *capture_device, const rate_plan_t *plan);
+void calibration_note_frame(const SMPTETimecode *tc, const rate_plan_t *plan, long tv_nsec);
+int calibration_finish(output_t *playback);
+
+#endif // LTC_CALIBRATE_H
@@ -12,7 +12,7 @@
 #include <sched.h>
 
 // Constants
-#define SAMPLE_RATE 48000
+#define DEFAULT_SAMPLE_RATE 48000   // When sample-rate is auto and the device has no preference
 #define DEFAULT_PCM_DEVICE "default"
 #define CHANNELS 1
 #define DEFAULT_CONFIG_FILE "/etc/ltc_timecode_pi.conf"
@@ -20,6 +20,17 @@
 #define MICROSECONDS_PER_SECOND 1000000LL
 #define NANOSECONDS_PER_MICROSECOND 1000LL
 
+// Output buffering. A period (one wakeup and one write) carries
+// frames-per-period LTC frames; the buffer holds the original four frames,
+// or two periods once that is more.
+#define MAX_FRAMES_PER_PERIOD 8
+#define BUFFER_FRAMES(frames_per_period) ((frames_per_period) * 2 > 4 ? (frames_per_period) * 2 : 4)
+
+// ALSA access modes (alsa-access config option)
+#define ALSA_ACCESS_AUTO 0   // Try mmap, fall back to read/write
+#define ALSA_ACCESS_MMAP 1   // Prefer mmap, warn if unavailable
+#define ALSA_ACCESS_RW   2   // Always use snd_pcm_writei
+
 // Some libltc installs do not define LTC_TV_STANDARD, use int instead and define constants
 #ifndef LTC_TV_525_60
 #define LTC_TV_525_60 0
@@ -28,14 +39,64 @@
 #define LTC_TV_625_50 1
 #endif
 
-// Structure for framerate specification
+// Rational frame rate descriptor. Rates above 30 fps carry LTC as frame
+// pairs (SMPTE ST 12-1): one 80-bit word every ltc_divisor video frames.
 typedef struct {
-    double fps;
-    int std;         // Use int instead of LTC_TV_STANDARD for compatibility
-    int drop_frame;
+    int fps_num;        // Video frame rate = fps_num / fps_den (e.g. 30000/1001)
+    int fps_den;
+    int ltc_divisor;    // Video frames per LTC word
+    int std;            // Use int instead of LTC_TV_STANDARD for compatibility
+    int drop_frame;     // Frame numbers 0 and 1 are skipped each minute except every tenth
     const char* name;
 } framerate_spec_t;
 
+// Sample cadence for rates whose frame length is not a whole number of samples
+// (e.g. 1601.6 samples per frame for 29.97 fps at 48 kHz). Frame lengths
+// alternate so the cumulative sample position matches the rational rate exactly.
+typedef struct {
+    int64_t num;    // Samples per frame = num / den (reduced)
+    int64_t den;
+    int64_t acc;    // Error accumulator, 0 <= acc < den
+    int base;       // Shortest frame length in samples
+} frame_cadence_t;
+
+// Fixed point shift for the frame-in-second reciprocal. 2^52 exceeds
+// den * 10^12 for every supported rate, which keeps the result exact.
+#define RATE_FRAME_SHIFT 52
+
+// Per-rate constants precomputed for one sample rate, so the per-frame math
+// is integer multiply/shift only
+typedef struct {
+    const framerate_spec_t *spec;
+    unsigned int sample_rate;
+    int64_t ltc_num;            // LTC word rate = ltc_num / ltc_den (reduced)
+    int64_t ltc_den;
+    int frames_per_second;      // Nominal LTC frames per second (30 for 29.97)
+    int64_t us_per_frame;       // LTC frame duration, rounded down
+    uint64_t frame_mult;        // Frame in second = (frac_us * frame_mult) >> RATE_FRAME_SHIFT
+    int64_t frames_per_day;     // Frame count of a full day, drop-frame aware
+    frame_cadence_t cadence;    // Samples-per-frame cadence at sample_rate
+} rate_plan_t;
+
+// Timecode generation modes (timecode-mode config option)
+#define TIMECODE_WALLCLOCK   0   // Recompute every frame from the compensated wall clock
+#define TIMECODE_INCREMENTAL 1   // Count frames, re-anchor to the wall clock only on drift
+#define TIMECODE_PLL         2   // Count frames, discipline the audio clock to the wall clock
+
+// Frame counter state for incremental mode
+typedef struct {
+    SMPTETimecode tc;          // Timecode of the last frame handed out
+    int valid;                 // Set once jammed to the wall clock
+    int frames_until_check;    // Frames left before the next wall clock comparison
+    unsigned long jams;        // Number of times the counter was re-anchored
+} tc_counter_t;
+
+// Output sink (ltc_output.h)
+typedef struct output output_t;
+
+// Clock state of whichever thread produces frames (ltc_pipeline.h)
+typedef struct frame_clock frame_clock_t;
+
 // Supported rates
 extern const framerate_spec_t supported_rates[];
 extern const int NUM_SUPPORTED_RATES;
@@ -43,32 +104,54 @@ extern const int NUM_SUPPORTED_RATES;
 // Shared state for timecode display thread
 typedef struct {
     pthread_mutex_t lock;
-    SMPTETimecode tc;         // Current timecode being displayed
-    double fps;
-    int drop_frame;
+    SMPTETimecode tc;         // Timecode last shown
+    const rate_plan_t *plan;
     int running;
-    snd_pcm_t *pcm;           // PCM handle to query buffer state
+    output_t *output;         // Output sink to query buffer state
     int64_t ntp_offset;       // Current NTP offset to apply
 } timecode_display_state_t;
 
 // Global variables that need to be shared
 extern volatile sig_atomic_t running;
 extern int use_ntp;
-extern int64_t ntp_offset_us;
-extern int64_t ntp_target_offset_us; 
-extern pthread_mutex_t ntp_lock;
+extern int alsa_access_mode;
+extern int frames_per_period;
+extern int timecode_mode;
+extern int resync_interval_frames;
+extern int resync_threshold_frames;
 
 // Function declarations
-void format_timecode(char *buf, size_t n, const SMPTETimecode *tc, double fps, int drop_frame);
+void format_timecode(char *buf, size_t n, const SMPTETimecode *tc, const rate_plan_t *plan);
 void pin_to_core(int core_id);
-void get_timecode_with_alsa_latency(SMPTETimecode *tc, double fps, snd_pcm_t *pcm, int drop_frame);
-void get_display_timecode(SMPTETimecode *tc, double fps, int drop_frame, int64_t ntp_offset);
+void unpin_from_core(int core_id);
+void drop_realtime(int core_id);
+int64_t get_output_time_us(frame_clock_t *clock, const rate_plan_t *plan, output_t *out, long *tv_nsec);
+void timecode_at(frame_clock_t *clock, SMPTETimecode *tc, const rate_plan_t *plan, int64_t adj_time_us);
+int64_t frame_boundary_after(const rate_plan_t *plan, int64_t time_us, int *frame);
+void get_timecode_with_latency(frame_clock_t *clock, SMPTETimecode *tc, const rate_plan_t *plan, output_t *out);
+void get_display_timecode(SMPTETimecode *tc, const rate_plan_t *plan, int64_t ntp_offset);
+void get_timecode_incremental(tc_counter_t *counter, frame_clock_t *clock, SMPTETimecode *tc, const rate_plan_t *plan, output_t *out);
+void timecode_increment(SMPTETimecode *tc, const rate_plan_t *plan);
+int64_t timecode_to_frames(const SMPTETimecode *tc, const rate_plan_t *plan);
+void timecode_from_frames(SMPTETimecode *tc, const rate_plan_t *plan, int64_t frames);
 void set_realtime_priority(void);
 int is_console_interactive(void);
 const framerate_spec_t* parse_rate(const char* arg);
-int configure_alsa_for_low_latency(snd_pcm_t *pcm, unsigned int rate, int ltc_frame_size);
+double framerate_fps(const framerate_spec_t *rate);
+void rate_plan_init(rate_plan_t *plan, const framerate_spec_t *rate, unsigned int sample_rate);
+void cadence_init(frame_cadence_t *c, const rate_plan_t *plan);
+int cadence_next(frame_cadence_t *c);
+int cadence_max(const frame_cadence_t *c);
+int64_t cadence_position(const frame_cadence_t *c, int64_t frame);
+void cadence_seek(frame_cadence_t *c, int64_t frame);
+int configure_alsa_for_low_latency(snd_pcm_t *pcm, snd_pcm_format_t format, unsigned int rate,
+                                   int ltc_frame_size, snd_pcm_uframes_t avail_min, int *use_mmap);
+int alsa_mmap_begin_frame(snd_pcm_t *pcm, snd_pcm_uframes_t frames, void **dst, snd_pcm_uframes_t *offset);
+int alsa_mmap_commit_frame(snd_pcm_t *pcm, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames);
+int alsa_mmap_write(snd_pcm_t *pcm, const void *buf, snd_pcm_uframes_t frames);
 
 // Thread functions
 void* timecode_display_thread(void *arg);
+void timecode_display_update(timecode_display_state_t *display);
 
 #endif // LTC_COMMON_H
\ No newline at end of file
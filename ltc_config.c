@@ -1,5 +1,14 @@
 #include "ltc_config.h"
 #include "ltc_ntp.h"
+#include "ltc_synth.h"
+#include "ltc_correction.h"
+#include "ltc_latency.h"
+#include "ltc_pll.h"
+#include "ltc_calibrate.h"
+#include "ltc_pipeline.h"
+#include "ltc_reactor.h"
+#include "ltc_format.h"
+#include "ltc_state.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -14,15 +23,74 @@ void print_usage(const char* prog) {
     fprintf(stderr, "  -q, --quiet                   Suppress console timecode output (recommended for service)\n");
     fprintf(stderr, "  -d, --device                  ALSA PCM device string (default: \"default\")\n");
     fprintf(stderr, "  --config <file>               Use specified config file (default: /etc/ltc_timecode_pi.conf)\n");
-    fprintf(stderr, "  --ntp-server <host>           Sync to NTP server instead of system clock\n");
+    fprintf(stderr, "  --ntp-server <hosts>          Sync to NTP server(s), comma separated, instead of system clock\n");
     fprintf(stderr, "  --ntp-sync-interval <seconds> Set NTP sync interval in seconds (default: 60)\n");
     fprintf(stderr, "  --ntp-slew-period <seconds>   Period over which to gradually adjust time (default: 30)\n");
+    fprintf(stderr, "  --alsa-access <mode>          ALSA access: auto, mmap or rw (default: auto)\n");
+    fprintf(stderr, "  --encoder <name>              LTC encoder: builtin or libltc (default: builtin)\n");
+    fprintf(stderr, "  --timecode-mode <mode>        wallclock, incremental or pll (default: wallclock)\n");
+    fprintf(stderr, "  --resync-interval <frames>    Incremental/pll mode: frames between wall clock checks (default: 250)\n");
+    fprintf(stderr, "  --resync-threshold <frames>   Incremental/pll mode: error that triggers a re-jam (default: 2)\n");
+    fprintf(stderr, "  --lookahead-frames <n>        Frames pre-rendered off the audio thread, 0 renders inline (default: 4)\n");
+    fprintf(stderr, "  --frames-per-period <n>       LTC frames encoded per ALSA period and written at once (default: 1)\n");
+    fprintf(stderr, "  --sample-format <format>      auto, s16, s32, s24_3le, s24 or float (default: auto)\n");
+    fprintf(stderr, "  --sample-rate <hz>            Output sample rate, or auto for the device's own (default: auto)\n");
+    fprintf(stderr, "  --event-loop <mode>           threads, single or split (default: threads)\n");
+    fprintf(stderr, "  --latency-source <source>     auto, clock, htstamp, link or link-absolute (default: auto)\n");
+    fprintf(stderr, "  --calibrate <capture-device>  Measure output latency via a loopback capture and save a profile\n");
+    fprintf(stderr, "  --render <file>               Render LTC offline to a WAV/BWF or raw file and exit\n");
+    fprintf(stderr, "  --render-start <timecode>     Render: first timecode, HH:MM:SS:FF (default: 00:00:00:00)\n");
+    fprintf(stderr, "  --render-duration <seconds>   Render: length in seconds (default: 60)\n");
+    fprintf(stderr, "  --render-format <format>      Render: auto, wav, bwf or raw (default: auto)\n");
+    fprintf(stderr, "  --render-threads <n>          Render: worker threads (default: one per CPU)\n");
+    fprintf(stderr, "  --benchmark                   Run the built-in microbenchmarks and exit\n");
     fprintf(stderr, "Supported frame rates:\n");
     for (size_t i = 0; i < NUM_SUPPORTED_RATES; ++i) {
         fprintf(stderr, "  %s\n", supported_rates[i].name);
     }
 }
 
+// Parse an alsa-access value, returns -1 if not recognised
+int parse_alsa_access(const char *val) {
+    if (strcmp(val, "auto") == 0) return ALSA_ACCESS_AUTO;
+    if (strcmp(val, "mmap") == 0) return ALSA_ACCESS_MMAP;
+    if (strcmp(val, "rw") == 0) return ALSA_ACCESS_RW;
+    return -1;
+}
+
+// Parse an encoder value, returns -1 if not recognised
+int parse_encoder_mode(const char *val) {
+    if (strcmp(val, "builtin") == 0) return ENCODER_BUILTIN;
+    if (strcmp(val, "libltc") == 0) return ENCODER_LIBLTC;
+    return -1;
+}
+
+// Parse a timecode-mode value, returns -1 if not recognised
+int parse_timecode_mode(const char *val) {
+    if (strcmp(val, "wallclock") == 0) return TIMECODE_WALLCLOCK;
+    if (strcmp(val, "incremental") == 0) return TIMECODE_INCREMENTAL;
+    if (strcmp(val, "pll") == 0) return TIMECODE_PLL;
+    return -1;
+}
+
+// Parse a latency-source value, returns -1 if not recognised
+int parse_latency_source(const char *val) {
+    if (strcmp(val, "auto") == 0) return LATENCY_SOURCE_AUTO;
+    if (strcmp(val, "clock") == 0) return LATENCY_SOURCE_CLOCK;
+    if (strcmp(val, "htstamp") == 0) return LATENCY_SOURCE_HTSTAMP;
+    if (strcmp(val, "link") == 0) return LATENCY_SOURCE_LINK;
+    if (strcmp(val, "link-absolute") == 0) return LATENCY_SOURCE_LINK_ABSOLUTE;
+    return -1;
+}
+
+// Parse an event-loop value, returns -1 if not recognised
+int parse_event_loop(const char *val) {
+    if (strcmp(val, "threads") == 0) return EVENT_LOOP_THREADS;
+    if (strcmp(val, "single") == 0) return EVENT_LOOP_SINGLE;
+    if (strcmp(val, "split") == 0) return EVENT_LOOP_SPLIT;
+    return -1;
+}
+
 void parse_config(const char *filename) {
     FILE *f = fopen(filename, "r");
     if (!f) return;
@@ -49,11 +117,109 @@ void parse_config(const char *filename) {
             if (ntp_sync_interval < 1) {
                 ntp_sync_interval = 60; // Default to 1 minute if invalid
             }
+        } else if (strcmp(key, "ntp-status-file") == 0) {
+            strncpy(ntp_status_file, val, sizeof(ntp_status_file)-1);
         } else if (strcmp(key, "ntp-slew-period") == 0) {
             ntp_slew_period = atoi(val);
             if (ntp_slew_period < 1) {
                 ntp_slew_period = 30; // Default to 30 seconds if invalid
             }
+        } else if (strcmp(key, "alsa-access") == 0) {
+            int mode = parse_alsa_access(val);
+            if (mode >= 0) {
+                alsa_access_mode = mode;
+            } else {
+                fprintf(stderr, "Warning: Invalid alsa-access '%s', using auto\n", val);
+            }
+        } else if (strcmp(key, "encoder") == 0) {
+            int mode = parse_encoder_mode(val);
+            if (mode >= 0) {
+                encoder_mode = mode;
+            } else {
+                fprintf(stderr, "Warning: Invalid encoder '%s', using builtin\n", val);
+            }
+        } else if (strcmp(key, "timecode-mode") == 0) {
+            int mode = parse_timecode_mode(val);
+            if (mode >= 0) {
+                timecode_mode = mode;
+            } else {
+                fprintf(stderr, "Warning: Invalid timecode-mode '%s', using wallclock\n", val);
+            }
+        } else if (strcmp(key, "resync-interval") == 0) {
+            resync_interval_frames = atoi(val);
+            if (resync_interval_frames < 1) {
+                resync_interval_frames = 250; // Default to 250 frames if invalid
+            }
+        } else if (strcmp(key, "resync-threshold") == 0) {
+            resync_threshold_frames = atoi(val);
+            if (resync_threshold_frames < 0) {
+                resync_threshold_frames = 2; // Default to 2 frames if invalid
+            }
+        } else if (strcmp(key, "pll-time-constant") == 0) {
+            pll_time_constant = atof(val);
+            if (pll_time_constant <= 0.0) {
+                pll_time_constant = PLL_DEFAULT_TIME_CONSTANT;
+            }
+        } else if (strcmp(key, "lookahead-frames") == 0) {
+            lookahead_frames = atoi(val);
+            if (lookahead_frames < 0 || lookahead_frames > PIPELINE_MAX_LOOKAHEAD) {
+                lookahead_frames = PIPELINE_DEFAULT_LOOKAHEAD;
+            }
+        } else if (strcmp(key, "frames-per-period") == 0) {
+            frames_per_period = atoi(val);
+            if (frames_per_period < 1 || frames_per_period > MAX_FRAMES_PER_PERIOD) {
+                frames_per_period = 1; // Default to one frame per period if invalid
+            }
+        } else if (strcmp(key, "sample-format") == 0) {
+            int format = parse_sample_format(val);
+            if (format >= 0) {
+                sample_format_mode = format;
+            } else {
+                fprintf(stderr, "Warning: Invalid sample-format '%s', using auto\n", val);
+            }
+        } else if (strcmp(key, "sample-rate") == 0) {
+            if (parse_sample_rate(val, &sample_rate_setting) < 0) {
+                fprintf(stderr, "Warning: Invalid sample-rate '%s', using auto\n", val);
+                sample_rate_setting = 0;
+            }
+        } else if (strcmp(key, "event-loop") == 0) {
+            int mode = parse_event_loop(val);
+            if (mode >= 0) {
+                event_loop_mode = mode;
+            } else {
+                fprintf(stderr, "Warning: Invalid event-loop '%s', using threads\n", val);
+            }
+        } else if (strcmp(key, "calibration-dir") == 0) {
+            strncpy(calibration_dir, val, sizeof(calibration_dir)-1);
+            calibration_dir[sizeof(calibration_dir)-1] = 0;
+        } else if (strcmp(key, "state-file") == 0) {
+            strncpy(state_file, val, sizeof(state_file)-1);
+            state_file[sizeof(state_file)-1] = 0;
+        } else if (strcmp(key, "calibration-frames") == 0) {
+            calibration_frames = atoi(val);
+            if (calibration_frames < 1) {
+                calibration_frames = CALIBRATION_DEFAULT_FRAMES;
+            }
+        } else if (strcmp(key, "latency-source") == 0) {
+            int source = parse_latency_source(val);
+            if (source >= 0) {
+                latency_source_mode = source;
+            } else {
+                fprintf(stderr, "Warning: Invalid latency-source '%s', using auto\n", val);
+            }
+        } else if (strcmp(key, "correction-min-frames") == 0) {
+            correction_curve.min_frames = atof(val);
+        } else if (strcmp(key, "correction-max-frames") == 0) {
+            correction_curve.max_frames = atof(val);
+        } else if (strcmp(key, "correction-decay") == 0) {
+            correction_curve.decay = atof(val);
+            if (correction_curve.decay < 0.0) {
+                correction_curve.decay = 3.0; // Default decay rate if invalid
+            }
+        } else if (strcmp(key, "correction-phase") == 0) {
+            correction_curve.phase = atof(val);
+        } else if (strcmp(key, "correction-quadratic") == 0) {
+            correction_curve.quadratic = atof(val);
         }
     }
     
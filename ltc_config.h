@@ -6,6 +6,11 @@
 // Configuration functions
 void parse_config(const char *filename);
 void print_usage(const char* prog);
+int parse_alsa_access(const char *val);
+int parse_encoder_mode(const char *val);
+int parse_timecode_mode(const char *val);
+int parse_latency_source(const char *val);
+int parse_event_loop(const char *val);
 
 // Helper function to get config value by key
 int get_config_value(const char *key, char *value, size_t value_size);
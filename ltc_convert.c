@@ -0,0 +1,164 @@
+#include "ltc_convert.h"
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL 1
+#define NEON_TARGET
+#elif defined(__arm__) && defined(__ARM_FP) && defined(__GNUC__) && __GNUC__ >= 8
+// 32-bit builds normally target plain VFP so they also run on ARMv6 boards;
+// only the kernel itself is compiled for NEON and it is gated on HWCAP_NEON
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define HAVE_NEON_KERNEL 1
+#define NEON_TARGET __attribute__((target("fpu=neon")))
+#endif
+
+// The float conversion s = x / 127.0f, clamped to [-1, 1] and scaled by
+// 32767 reduces exactly to x * 258 + x / 127 (truncated) with x clamped to
+// [-127, 127], since 32767 = 127 * 258 + 1. The second term is only non-zero
+// at the end points, which lets every kernel stay in 16-bit integer lanes.
+#define CONVERT_MULTIPLIER 258
+#define CONVERT_LIMIT 127
+
+void convert_s8_reference(int16_t *dst, const int8_t *src, int n) {
+    const int16_t max_amp = INT16_MAX;
+    for (int i = 0; i < n; ++i) {
+        float s = src[i] / 127.0f;
+        if (s > 1.0f) s = 1.0f;
+        if (s < -1.0f) s = -1.0f;
+        dst[i] = (int16_t)(s * max_amp);
+    }
+}
+
+static inline int16_t convert_one(int8_t sample) {
+    int x = sample < -CONVERT_LIMIT ? -CONVERT_LIMIT : sample;
+    return (int16_t)(x * CONVERT_MULTIPLIER + (x == CONVERT_LIMIT) - (x == -CONVERT_LIMIT));
+}
+
+static void convert_scalar(int16_t *dst, const int8_t *src, int n) {
+    for (int i = 0; i < n; ++i) {
+        dst[i] = convert_one(src[i]);
+    }
+}
+
+static int always_supported(void) {
+    return 1;
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+static inline __m128i convert_lane_sse2(__m128i x) {
+    const __m128i lo = _mm_set1_epi16(-CONVERT_LIMIT);
+    const __m128i hi = _mm_set1_epi16(CONVERT_LIMIT);
+    x = _mm_max_epi16(x, lo);
+    __m128i r = _mm_mullo_epi16(x, _mm_set1_epi16(CONVERT_MULTIPLIER));
+    // Compare masks are -1 where true
+    r = _mm_sub_epi16(r, _mm_cmpeq_epi16(x, hi));
+    return _mm_add_epi16(r, _mm_cmpeq_epi16(x, lo));
+}
+
+__attribute__((target("sse2")))
+static void convert_sse2(int16_t *dst, const int8_t *src, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), v);
+        _mm_storeu_si128((__m128i*)(dst + i), convert_lane_sse2(_mm_unpacklo_epi8(v, sign)));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), convert_lane_sse2(_mm_unpackhi_epi8(v, sign)));
+    }
+    convert_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i convert_lane_avx2(__m256i x) {
+    const __m256i lo = _mm256_set1_epi16(-CONVERT_LIMIT);
+    const __m256i hi = _mm256_set1_epi16(CONVERT_LIMIT);
+    x = _mm256_max_epi16(x, lo);
+    __m256i r = _mm256_mullo_epi16(x, _mm256_set1_epi16(CONVERT_MULTIPLIER));
+    r = _mm256_sub_epi16(r, _mm256_cmpeq_epi16(x, hi));
+    return _mm256_add_epi16(r, _mm256_cmpeq_epi16(x, lo));
+}
+
+__attribute__((target("avx2")))
+static void convert_avx2(int16_t *dst, const int8_t *src, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i b = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(src + i + 16)));
+        _mm256_storeu_si256((__m256i*)(dst + i), convert_lane_avx2(a));
+        _mm256_storeu_si256((__m256i*)(dst + i + 16), convert_lane_avx2(b));
+    }
+    convert_scalar(dst + i, src + i, n - i);
+}
+
+static int sse2_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static int avx2_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif // HAVE_X86_KERNELS
+
+#ifdef HAVE_NEON_KERNEL
+NEON_TARGET
+static void convert_neon(int16_t *dst, const int8_t *src, int n) {
+    const int16x8_t lo = vdupq_n_s16(-CONVERT_LIMIT);
+    const int16x8_t hi = vdupq_n_s16(CONVERT_LIMIT);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int8x16_t v = vld1q_s8(src + i);
+        int16x8_t a = vmaxq_s16(vmovl_s8(vget_low_s8(v)), lo);
+        int16x8_t b = vmaxq_s16(vmovl_s8(vget_high_s8(v)), lo);
+        int16x8_t ra = vmulq_n_s16(a, CONVERT_MULTIPLIER);
+        int16x8_t rb = vmulq_n_s16(b, CONVERT_MULTIPLIER);
+        // Compare masks are all ones (-1) where true
+        ra = vsubq_s16(ra, vreinterpretq_s16_u16(vceqq_s16(a, hi)));
+        rb = vsubq_s16(rb, vreinterpretq_s16_u16(vceqq_s16(b, hi)));
+        ra = vaddq_s16(ra, vreinterpretq_s16_u16(vceqq_s16(a, lo)));
+        rb = vaddq_s16(rb, vreinterpretq_s16_u16(vceqq_s16(b, lo)));
+        vst1q_s16(dst + i, ra);
+        vst1q_s16(dst + i + 8, rb);
+    }
+    convert_scalar(dst + i, src + i, n - i);
+}
+
+static int neon_supported(void) {
+#if defined(__aarch64__)
+    return 1; // Advanced SIMD is mandatory on ARMv8
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+}
+#endif // HAVE_NEON_KERNEL
+
+const convert_kernel_t convert_kernels[] = {
+#ifdef HAVE_X86_KERNELS
+    {"avx2",   convert_avx2,   avx2_supported},
+    {"sse2",   convert_sse2,   sse2_supported},
+#endif
+#ifdef HAVE_NEON_KERNEL
+    {"neon",   convert_neon,   neon_supported},
+#endif
+    {"scalar", convert_scalar, always_supported}
+};
+
+const int NUM_CONVERT_KERNELS = sizeof(convert_kernels)/sizeof(convert_kernels[0]);
+
+const convert_kernel_t *convert_select(void) {
+    for (int i = 0; i < NUM_CONVERT_KERNELS; i++) {
+        if (convert_kernels[i].supported()) {
+            return &convert_kernels[i];
+        }
+    }
+    return &convert_kernels[NUM_CONVERT_KERNELS - 1];
+}
@@ -0,0 +1,26 @@
+#ifndef LTC_CONVERT_H
+#define LTC_CONVERT_H
+
+#include <stdint.h>
+
+// Kernel converting libltc's signed 8-bit samples to full scale int16.
+// All kernels produce output bit-identical to convert_s8_reference.
+typedef void (*convert_s8_fn)(int16_t *dst, const int8_t *src, int n);
+
+typedef struct {
+    const char *name;
+    convert_s8_fn fn;
+    int (*supported)(void);   // Runtime CPU feature check
+} convert_kernel_t;
+
+// Available kernels, best first
+extern const convert_kernel_t convert_kernels[];
+extern const int NUM_CONVERT_KERNELS;
+
+// Original floating point conversion, kept as the reference for validation
+void convert_s8_reference(int16_t *dst, const int8_t *src, int n);
+
+// Pick the fastest kernel the running CPU supports
+const convert_kernel_t *convert_select(void);
+
+#endif // LTC_CONVERT_H
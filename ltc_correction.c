@@ -0,0 +1,35 @@
+#include "ltc_correction.h"
+#include <math.h>
+
+// Defaults reproduce the original hardcoded curve. The original stored the
+// frame bounds in integers, so its 3.5 frame maximum was effectively 3.
+correction_curve_t correction_curve = {
+    .min_frames = 1.0,
+    .max_frames = 3.0,
+    .decay = 3.0,
+    .phase = 0.2,
+    .quadratic = 0.3
+};
+
+correction_table_t correction_table;
+
+void correction_build(correction_table_t *table, const correction_curve_t *curve,
+                      const rate_plan_t *plan) {
+    int64_t sum = 0;
+    for (int i = 0; i < CORRECTION_BUCKETS; i++) {
+        // Sample each bucket at its midpoint to halve the quantisation error
+        int64_t ns = ((int64_t)i << CORRECTION_BUCKET_SHIFT) + (1 << (CORRECTION_BUCKET_SHIFT - 1));
+        if (ns > 999999999) ns = 999999999;
+        double second_fraction = (double)ns / 1000000000.0;
+
+        double normalized_position = 1.0 - exp(-curve->decay * second_fraction);
+        double offset_frames = curve->max_frames -
+                               normalized_position * (curve->max_frames - curve->min_frames);
+        offset_frames += curve->phase * sin(2 * M_PI * second_fraction);
+        offset_frames += curve->quadratic * (1.0 - second_fraction * second_fraction);
+
+        table->offset_us[i] = (int32_t)(plan->us_per_frame * offset_frames);
+        sum += table->offset_us[i];
+    }
+    table->mean_us = (int32_t)(sum / CORRECTION_BUCKETS);
+}
@@ -0,0 +1,40 @@
+#ifndef LTC_CORRECTION_H
+#define LTC_CORRECTION_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+
+// The correction table is indexed by tv_nsec >> CORRECTION_BUCKET_SHIFT,
+// which gives 3815 buckets of ~262us across one second
+#define CORRECTION_BUCKET_SHIFT 18
+#define CORRECTION_BUCKETS ((999999999 >> CORRECTION_BUCKET_SHIFT) + 1)
+
+// Shape of the adaptive processing offset, in frames, over one second:
+//   max - (1 - exp(-decay * x)) * (max - min) + phase * sin(2 pi x) + quadratic * (1 - x^2)
+typedef struct {
+    double min_frames;        // Offset approached near the end of the second
+    double max_frames;        // Offset at the start of the second
+    double decay;             // Exponential decay rate from max toward min
+    double phase;             // Amplitude of the once-per-second sine term
+    double quadratic;         // Extra start-of-second weighting
+} correction_curve_t;
+
+// Processing offset in microseconds for every bucket of the second
+typedef struct {
+    int32_t offset_us[CORRECTION_BUCKETS];
+    int32_t mean_us;          // Average over the second, for modes that need a constant offset
+} correction_table_t;
+
+extern correction_curve_t correction_curve;
+extern correction_table_t correction_table;
+
+// Evaluate the curve for one rate plan. Call at startup and whenever the
+// curve or the rate changes; the audio thread only ever reads the table.
+void correction_build(correction_table_t *table, const correction_curve_t *curve,
+                      const rate_plan_t *plan);
+
+static inline int64_t correction_lookup(const correction_table_t *table, long tv_nsec) {
+    return table->offset_us[tv_nsec >> CORRECTION_BUCKET_SHIFT];
+}
+
+#endif // LTC_CORRECTION_H
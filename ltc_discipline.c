@@ -0,0 +1,124 @@
+#include "ltc_discipline.h"
+#include <string.h>
+#include <math.h>
+
+#define RMS_AVERAGE 8   // Updates in the running RMS averages
+
+int64_t clock_correction_at(const clock_correction_t *c, int64_t now_us) {
+    int64_t elapsed = now_us - c->base_us;
+    int64_t slew_us = (int64_t)c->slew_s * MICROSECONDS_PER_SECOND;
+    int64_t phase = c->phase_us;
+    if (elapsed < slew_us) {
+        phase = elapsed > 0 ? c->phase_us * elapsed / slew_us : 0;
+    }
+    return c->base_offset_us + elapsed * c->freq_ppb / 1000000000LL + phase;
+}
+
+// Where the curve heads once its phase has been taken up
+static int64_t correction_settled_at(const clock_correction_t *c, int64_t now_us) {
+    return c->base_offset_us + c->phase_us + (now_us - c->base_us) * c->freq_ppb / 1000000000LL;
+}
+
+static void running_rms(double *rms, double value) {
+    *rms = sqrt((*rms * *rms * (RMS_AVERAGE - 1) + value * value) / RMS_AVERAGE);
+}
+
+void discipline_init(clock_discipline_t *d) {
+    memset(d, 0, sizeof(*d));
+    d->state = DISCIPLINE_UNSET;
+}
+
+void discipline_restore(clock_discipline_t *d, int32_t freq_ppb, int64_t offset_us,
+                        int64_t now_us, int slew_s) {
+    discipline_init(d);
+    d->state = DISCIPLINE_FSET;
+    d->correction.base_us = now_us;
+    d->correction.base_offset_us = offset_us;
+    d->correction.freq_ppb = freq_ppb;
+    d->correction.slew_s = (uint32_t)slew_s;
+    d->correction.generation = 1;
+}
+
+int discipline_update(clock_discipline_t *d, int64_t offset_us, int64_t sample_us,
+                      int64_t now_us, int slew_s) {
+    clock_correction_t *c = &d->correction;
+    int first = d->state == DISCIPLINE_UNSET || d->state == DISCIPLINE_FSET;
+    if (!first && sample_us <= d->sample_us) {
+        return 1;
+    }
+
+    int64_t interval = sample_us - d->sample_us;
+    // Error against what the curve applied at the sample, and against where
+    // it was heading: the part its frequency did not account for
+    int64_t residual = offset_us - clock_correction_at(c, sample_us);
+    int64_t freq_error = offset_us - correction_settled_at(c, sample_us);
+    double freq = c->freq_ppb;
+    double adjust = 0.0;
+
+    switch (d->state) {
+    case DISCIPLINE_UNSET:
+        d->state = DISCIPLINE_FREQ;
+        d->freq_sample_us = sample_us;
+        d->freq_offset_us = offset_us;
+        break;
+    case DISCIPLINE_FSET:
+        // Keep the saved frequency; only the phase is new
+        d->state = DISCIPLINE_SYNC;
+        break;
+    case DISCIPLINE_FREQ:
+        // Measure the frequency directly as the offset's rate of change, once
+        // the span is long enough to tell it from noise
+        if (sample_us - d->freq_sample_us >= DISCIPLINE_FREQ_MIN_US) {
+            freq = (double)(offset_us - d->freq_offset_us) * 1e9 /
+                   (double)(sample_us - d->freq_sample_us);
+            d->state = DISCIPLINE_SYNC;
+        }
+        break;
+    case DISCIPLINE_SYNC:
+        if (llabs(residual) > DISCIPLINE_STEP_US) {
+            // Something stepped the system clock: measure the frequency again
+            d->state = DISCIPLINE_FREQ;
+            d->freq_sample_us = sample_us;
+            d->freq_offset_us = offset_us;
+            break;
+        }
+        {
+            double fll = (double)interval / (double)DISCIPLINE_ALLAN_US;
+            double gain = DISCIPLINE_PLL_GAIN + (fll < 1.0 ? fll : 1.0);
+            if (gain > 1.0) gain = 1.0;
+            adjust = gain * (double)freq_error * 1e9 / (double)interval;
+        }
+        freq += adjust;
+        running_rms(&d->residual_rms_us, (double)residual);
+        running_rms(&d->wander_ppb, adjust);
+        break;
+    }
+    if (freq > DISCIPLINE_MAX_FREQ_PPB) freq = DISCIPLINE_MAX_FREQ_PPB;
+    if (freq < -DISCIPLINE_MAX_FREQ_PPB) freq = -DISCIPLINE_MAX_FREQ_PPB;
+
+    // New curve from now, continuous with the old one, aimed at the offset
+    // extrapolated from its sample at the new frequency
+    int64_t current = clock_correction_at(c, now_us);
+    int64_t target = offset_us + (now_us - sample_us) * (int64_t)llround(freq) / 1000000000LL;
+    c->base_us = now_us;
+    c->base_offset_us = current;
+    c->freq_ppb = (int32_t)llround(freq);
+    c->phase_us = (int32_t)(target - current);
+    c->slew_s = (uint32_t)slew_s;
+    c->generation++;
+
+    d->sample_us = sample_us;
+    d->offset_us = offset_us;
+    d->residual_us = residual;
+    d->updates++;
+    return 0;
+}
+
+const char *discipline_state_name(int state) {
+    switch (state) {
+    case DISCIPLINE_FREQ: return "freq";
+    case DISCIPLINE_SYNC: return "sync";
+    case DISCIPLINE_FSET: return "fset";
+    default: return "unset";
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef LTC_DISCIPLINE_H
+#define LTC_DISCIPLINE_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+
+// Discipline states
+#define DISCIPLINE_UNSET 0   // No offset yet
+#define DISCIPLINE_FREQ  1   // Phase set, measuring the frequency
+#define DISCIPLINE_SYNC  2   // Tracking phase and frequency
+#define DISCIPLINE_FSET  3   // Frequency restored from a previous run, no offset yet
+
+#define DISCIPLINE_MAX_FREQ_PPB 500000                             // +-500 ppm, as ntpd
+#define DISCIPLINE_STEP_US 128000                                  // Larger residuals restart the frequency measurement
+#define DISCIPLINE_FREQ_MIN_US (32 * MICROSECONDS_PER_SECOND)      // Shortest interval to measure the frequency over
+#define DISCIPLINE_ALLAN_US (1500 * (int64_t)MICROSECONDS_PER_SECOND) // FLL fully weighted at intervals this long
+#define DISCIPLINE_PLL_GAIN 0.0625                                 // PLL share of the frequency error per update
+
+// Correction to add to the system clock, as a function of CLOCK_MONOTONIC:
+//
+//   base_offset_us + freq_ppb * (t - base_us) + phase_us * min(t - base_us, slew) / slew
+//
+// The frequency term carries the estimated drift of the system clock
+// between syncs; the phase term removes the error found at the last sync
+// over slew_s seconds. Published by the NTP client, which starts every new
+// curve where the previous one had got to, and evaluated by the frame renderer
+// for each frame. Eight 32-bit words, the most the seqlock holds.
+typedef struct {
+    int64_t base_us;
+    int64_t base_offset_us;
+    int32_t freq_ppb;
+    int32_t phase_us;
+    uint32_t slew_s;
+    uint32_t generation;
+} clock_correction_t;
+
+// Hybrid PLL/FLL in the manner of RFC 5905: every update re-aims the phase
+// at the measured offset, and the frequency is corrected by the error the
+// previous curve had built up since its sample, with a small PLL gain plus
+// an FLL gain that grows with the interval between updates. The fields are
+// the monitoring state.
+typedef struct {
+    int state;
+    clock_correction_t correction;   // Last published
+    int64_t sample_us;               // When the last offset used was measured
+    int64_t offset_us;               // That offset
+    int64_t freq_sample_us;          // First sample of the frequency measurement
+    int64_t freq_offset_us;          // Its offset
+    int64_t residual_us;             // Its difference from the previous curve
+    double residual_rms_us;          // Running RMS of the residual in SYNC
+    double wander_ppb;               // Running RMS of the frequency changes in SYNC
+    unsigned long updates;
+} clock_discipline_t;
+
+int64_t clock_correction_at(const clock_correction_t *c, int64_t now_us);
+
+void discipline_init(clock_discipline_t *d);
+
+// Start from a saved frequency and offset instead of nothing, leaving
+// d->correction ready to publish. The first update goes straight to SYNC.
+void discipline_restore(clock_discipline_t *d, int32_t freq_ppb, int64_t offset_us,
+                        int64_t now_us, int slew_s);
+
+// Fold in an offset measured at sample_us and start a new curve at now_us.
+// Returns 1, changing nothing, if the sample is not newer than the last one
+// used, else 0 with d->correction ready to publish.
+int discipline_update(clock_discipline_t *d, int64_t offset_us, int64_t sample_us,
+                      int64_t now_us, int slew_s);
+
+const char *discipline_state_name(int state);
+
+#endif // LTC_DISCIPLINE_H
@@ -0,0 +1,107 @@
+#include "ltc_format.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Global variables
+int sample_format_mode = SAMPLE_FORMAT_AUTO;
+unsigned int sample_rate_setting = 0;
+
+static void store_s16(void *dst, const int32_t *src, int n) {
+    int16_t *d = (int16_t*)dst;
+    for (int i = 0; i < n; i++) {
+        d[i] = (int16_t)src[i];
+    }
+}
+
+static void store_s32(void *dst, const int32_t *src, int n) {
+    memcpy(dst, src, (size_t)n * sizeof(int32_t));
+}
+
+static void store_s24_3le(void *dst, const int32_t *src, int n) {
+    uint8_t *d = (uint8_t*)dst;
+    for (int i = 0; i < n; i++) {
+        uint32_t v = (uint32_t)src[i];
+        d[0] = (uint8_t)v;
+        d[1] = (uint8_t)(v >> 8);
+        d[2] = (uint8_t)(v >> 16);
+        d += 3;
+    }
+}
+
+static void store_float(void *dst, const int32_t *src, int n) {
+    float *d = (float*)dst;
+    for (int i = 0; i < n; i++) {
+        d[i] = (float)src[i] / (float)INT32_MAX;
+    }
+}
+
+static void s16_to_s16(void *dst, const int16_t *src, int n) {
+    memcpy(dst, src, (size_t)n * sizeof(int16_t));
+}
+
+static void s16_to_s32(void *dst, const int16_t *src, int n) {
+    int32_t *d = (int32_t*)dst;
+    for (int i = 0; i < n; i++) {
+        d[i] = (int32_t)src[i] * 65536;
+    }
+}
+
+static void s16_to_s24_3le(void *dst, const int16_t *src, int n) {
+    uint8_t *d = (uint8_t*)dst;
+    for (int i = 0; i < n; i++) {
+        uint16_t v = (uint16_t)src[i];
+        d[0] = 0;
+        d[1] = (uint8_t)v;
+        d[2] = (uint8_t)(v >> 8);
+        d += 3;
+    }
+}
+
+static void s16_to_s24(void *dst, const int16_t *src, int n) {
+    int32_t *d = (int32_t*)dst;
+    for (int i = 0; i < n; i++) {
+        d[i] = (int32_t)src[i] * 256;
+    }
+}
+
+static void s16_to_float(void *dst, const int16_t *src, int n) {
+    float *d = (float*)dst;
+    for (int i = 0; i < n; i++) {
+        d[i] = (float)src[i] / (float)INT16_MAX;
+    }
+}
+
+// S24 shares the S32 store: the value already fits the low 24 bits and
+// ALSA ignores the sign-extended top byte
+const sample_format_t sample_formats[NUM_SAMPLE_FORMATS] = {
+    {"S16_LE",   SND_PCM_FORMAT_S16_LE,   2, INT16_MAX,  store_s16,     s16_to_s16},
+    {"S32_LE",   SND_PCM_FORMAT_S32_LE,   4, INT32_MAX,  store_s32,     s16_to_s32},
+    {"S24_3LE",  SND_PCM_FORMAT_S24_3LE,  3, 0x7fffff,   store_s24_3le, s16_to_s24_3le},
+    {"S24_LE",   SND_PCM_FORMAT_S24_LE,   4, 0x7fffff,   store_s32,     s16_to_s24},
+    {"FLOAT_LE", SND_PCM_FORMAT_FLOAT_LE, 4, INT32_MAX,  store_float,   s16_to_float}
+};
+
+// Parse a sample-format value, returns -1 if not recognised
+int parse_sample_format(const char *val) {
+    if (strcmp(val, "auto") == 0) return SAMPLE_FORMAT_AUTO;
+    if (strcmp(val, "s16") == 0) return SAMPLE_FORMAT_S16;
+    if (strcmp(val, "s32") == 0) return SAMPLE_FORMAT_S32;
+    if (strcmp(val, "s24_3le") == 0) return SAMPLE_FORMAT_S24_3LE;
+    if (strcmp(val, "s24") == 0) return SAMPLE_FORMAT_S24;
+    if (strcmp(val, "float") == 0) return SAMPLE_FORMAT_FLOAT;
+    return -1;
+}
+
+// Parse a sample-rate value (auto or Hz), returns -1 if not valid
+int parse_sample_rate(const char *val, unsigned int *rate) {
+    if (strcmp(val, "auto") == 0) {
+        *rate = 0;
+        return 0;
+    }
+    long hz = atol(val);
+    if (hz < 8000 || hz > 384000) {
+        return -1;
+    }
+    *rate = (unsigned int)hz;
+    return 0;
+}
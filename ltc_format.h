@@ -0,0 +1,45 @@
+#ifndef LTC_FORMAT_H
+#define LTC_FORMAT_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+
+// Output sample formats (sample-format config option), in the order they
+// are tried against the hardware: S16 first, as LTC gains nothing from more
+// bits, then the formats interfaces commonly take instead
+#define SAMPLE_FORMAT_S16      0
+#define SAMPLE_FORMAT_S32      1
+#define SAMPLE_FORMAT_S24_3LE  2   // Packed 24-bit
+#define SAMPLE_FORMAT_S24      3   // 24-bit in the low bytes of 32
+#define SAMPLE_FORMAT_FLOAT    4
+#define NUM_SAMPLE_FORMATS     5
+#define SAMPLE_FORMAT_AUTO     NUM_SAMPLE_FORMATS   // The first one the hardware takes natively
+
+// Sample rates tried when sample-rate is auto, best first
+#define SAMPLE_RATE_CANDIDATES {48000, 96000, 44100, 88200, 192000}
+
+// A sample format and its kernels. Samples are produced as int32 at the
+// format's own full scale (max), then stored in its wire layout.
+typedef struct {
+    const char *name;
+    snd_pcm_format_t alsa;
+    int bytes;                     // Per sample
+    int32_t max;                   // Full scale; float is stored divided by it
+    // Store n samples in the wire layout. Used to build synthesizer templates.
+    void (*store)(void *dst, const int32_t *src, int n);
+    // Widen n full scale int16 samples (libltc's converted output)
+    void (*from_s16)(void *dst, const int16_t *src, int n);
+} sample_format_t;
+
+extern const sample_format_t sample_formats[];
+extern int sample_format_mode;
+extern unsigned int sample_rate_setting;    // 0 = auto
+
+static inline const sample_format_t *sample_format_get(int id) {
+    return &sample_formats[id];
+}
+
+int parse_sample_format(const char *val);
+int parse_sample_rate(const char *val, unsigned int *rate);
+
+#endif // LTC_FORMAT_H
@@ -0,0 +1,178 @@
+#include "ltc_latency.h"
+#include <stdio.h>
+
+// Global variables
+int latency_source_mode = LATENCY_SOURCE_AUTO;
+
+// Only touched by the audio thread once configured
+static int active_source = LATENCY_SOURCE_CLOCK;
+static int htstamp_verified = 0;
+static uint64_t frames_written = 0;
+static int64_t link_base_us = 0;      // LINK_ABSOLUTE reading at stream start
+static int link_base_valid = 0;
+
+static inline int64_t timespec_us(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * MICROSECONDS_PER_SECOND + ts->tv_nsec / NANOSECONDS_PER_MICROSECOND;
+}
+
+const char *latency_source_name(int source) {
+    switch (source) {
+        case LATENCY_SOURCE_CLOCK:         return "clock";
+        case LATENCY_SOURCE_HTSTAMP:       return "htstamp";
+        case LATENCY_SOURCE_LINK:          return "link";
+        case LATENCY_SOURCE_LINK_ABSOLUTE: return "link-absolute";
+        default:                           return "auto";
+    }
+}
+
+int latency_active_source(void) {
+    return active_source;
+}
+
+int latency_configure(snd_pcm_t *pcm, snd_pcm_hw_params_t *hw_params, snd_pcm_sw_params_t *sw_params) {
+    int requested = latency_source_mode;
+    active_source = LATENCY_SOURCE_CLOCK;
+    htstamp_verified = 0;
+    latency_stream_reset();
+
+    if (requested == LATENCY_SOURCE_CLOCK) {
+        return active_source;
+    }
+
+    // Status timestamps must be on the same clock as the timecode (CLOCK_REALTIME)
+    if (snd_pcm_sw_params_set_tstamp_mode(pcm, sw_params, SND_PCM_TSTAMP_ENABLE) < 0 ||
+        snd_pcm_sw_params_set_tstamp_type(pcm, sw_params, SND_PCM_TSTAMP_TYPE_GETTIMEOFDAY) < 0) {
+        fprintf(stderr, "Warning: Device does not provide status timestamps, using clock latency source\n");
+        return active_source;
+    }
+    active_source = LATENCY_SOURCE_HTSTAMP;
+
+    int link_types[2] = {LATENCY_SOURCE_LINK, LATENCY_SOURCE_LINK_ABSOLUTE};
+    int audio_types[2] = {SND_PCM_AUDIO_TSTAMP_TYPE_LINK, SND_PCM_AUDIO_TSTAMP_TYPE_LINK_ABSOLUTE};
+    for (int i = 0; i < 2; i++) {
+        if (requested != LATENCY_SOURCE_AUTO && requested != link_types[i]) {
+            continue;
+        }
+        if (snd_pcm_hw_params_supports_audio_ts_type(hw_params, audio_types[i])) {
+            active_source = link_types[i];
+            break;
+        }
+    }
+
+    if (requested != LATENCY_SOURCE_AUTO && active_source != requested) {
+        fprintf(stderr, "Warning: Device does not support %s timestamps, using %s latency source\n",
+                latency_source_name(requested), latency_source_name(active_source));
+    }
+    return active_source;
+}
+
+void latency_frames_committed(snd_pcm_uframes_t frames) {
+    frames_written += frames;
+}
+
+void latency_stream_reset(void) {
+    frames_written = 0;
+    link_base_valid = 0;
+}
+
+// Refine the delay with the audio link position. Returns 0 and sets
+// *delay_us if the driver reported a usable link timestamp.
+static int link_delay(snd_pcm_status_t *status, unsigned int sample_rate, int64_t status_delay_us,
+                      const struct timespec *htstamp, int64_t *delay_us) {
+    snd_pcm_audio_tstamp_report_t report;
+    snd_htimestamp_t audio_ts;
+
+    snd_pcm_status_get_audio_htstamp_report(status, &report);
+    int expected = active_source == LATENCY_SOURCE_LINK ?
+                   SND_PCM_AUDIO_TSTAMP_TYPE_LINK : SND_PCM_AUDIO_TSTAMP_TYPE_LINK_ABSOLUTE;
+    if (!report.valid || (int)report.actual_type != expected) {
+        return -1;
+    }
+    snd_pcm_status_get_audio_htstamp(status, &audio_ts);
+    int64_t audio_us = timespec_us(&audio_ts);
+
+    // The absolute link counter does not restart with the stream; take its
+    // value at the trigger as the origin of the played position
+    if (active_source == LATENCY_SOURCE_LINK_ABSOLUTE) {
+        if (!link_base_valid) {
+            snd_htimestamp_t trigger_ts;
+            snd_pcm_status_get_trigger_htstamp(status, &trigger_ts);
+            link_base_us = audio_us - (timespec_us(htstamp) - timespec_us(&trigger_ts));
+            link_base_valid = 1;
+        }
+        audio_us -= link_base_us;
+    }
+
+    // Samples written but not yet audible, at sub-sample resolution
+    int64_t written_us = (int64_t)(frames_written * MICROSECONDS_PER_SECOND / sample_rate);
+    int64_t link_us = written_us - audio_us;
+    int64_t deviation = link_us - status_delay_us;
+    if (link_us < 0 || deviation > LATENCY_LINK_MAX_DEVIATION_US || deviation < -LATENCY_LINK_MAX_DEVIATION_US) {
+        return -1;
+    }
+    *delay_us = link_us;
+    return 0;
+}
+
+void latency_measure(snd_pcm_t *pcm, unsigned int sample_rate, struct timespec *ts, int64_t *delay_us) {
+    snd_pcm_sframes_t delay_frames = 0;
+    snd_pcm_status_t *status;
+    snd_pcm_status_alloca(&status);
+    int have_htstamp = 0;
+
+    if (active_source == LATENCY_SOURCE_CLOCK) {
+        clock_gettime(CLOCK_REALTIME, ts);
+    }
+    if (active_source == LATENCY_SOURCE_LINK || active_source == LATENCY_SOURCE_LINK_ABSOLUTE) {
+        snd_pcm_audio_tstamp_config_t config = {0};
+        config.type_requested = active_source == LATENCY_SOURCE_LINK ?
+                                SND_PCM_AUDIO_TSTAMP_TYPE_LINK : SND_PCM_AUDIO_TSTAMP_TYPE_LINK_ABSOLUTE;
+        config.report_delay = 1;
+        snd_pcm_status_set_audio_htstamp_config(status, &config);
+    }
+
+    // Get detailed PCM status
+    if (snd_pcm_status(pcm, status) >= 0) {
+        // Get delay in frames - this includes both hardware and software buffers
+        delay_frames = snd_pcm_status_get_delay(status);
+        if (active_source != LATENCY_SOURCE_CLOCK) {
+            snd_pcm_status_get_htstamp(status, ts);
+            have_htstamp = ts->tv_sec != 0 || ts->tv_nsec != 0;
+        }
+    } else {
+        // Fallback to simpler delay function if status call fails
+        if (snd_pcm_delay(pcm, &delay_frames) < 0) {
+            delay_frames = 0;
+        }
+    }
+
+    // Ensure delay is non-negative
+    if (delay_frames < 0) {
+        delay_frames = 0;
+    }
+
+    // The first timestamp is checked against the system clock in case the
+    // driver ignored the requested timestamp type
+    if (have_htstamp && !htstamp_verified) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64_t skew_us = timespec_us(&now) - timespec_us(ts);
+        if (skew_us > MICROSECONDS_PER_SECOND || skew_us < -MICROSECONDS_PER_SECOND) {
+            fprintf(stderr, "Warning: PCM timestamps are not on the system clock, using clock latency source\n");
+            active_source = LATENCY_SOURCE_CLOCK;
+            have_htstamp = 0;
+        }
+        htstamp_verified = 1;
+    }
+    if (active_source != LATENCY_SOURCE_CLOCK && !have_htstamp) {
+        clock_gettime(CLOCK_REALTIME, ts);
+    }
+
+    // Convert delay to microseconds with high precision
+    // Use 64-bit arithmetic throughout to avoid overflows and maximize precision
+    *delay_us = (delay_frames * MICROSECONDS_PER_SECOND + (sample_rate / 2)) / sample_rate;
+
+    if (have_htstamp && active_source >= LATENCY_SOURCE_LINK) {
+        link_delay(status, sample_rate, *delay_us, ts, delay_us);
+    }
+}
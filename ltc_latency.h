@@ -0,0 +1,37 @@
+#ifndef LTC_LATENCY_H
+#define LTC_LATENCY_H
+
+#include <stdint.h>
+#include <time.h>
+#include "ltc_common.h"
+
+// Where the output latency measurement comes from (latency-source option)
+#define LATENCY_SOURCE_AUTO          0  // Best source the driver supports
+#define LATENCY_SOURCE_CLOCK         1  // clock_gettime, then snd_pcm_status delay (original)
+#define LATENCY_SOURCE_HTSTAMP       2  // Delay and the system time it was sampled at, from one status
+#define LATENCY_SOURCE_LINK          3  // Audio link timestamp relative to stream start
+#define LATENCY_SOURCE_LINK_ABSOLUTE 4  // Free-running audio link timestamp
+
+// Largest disagreement between a link timestamp and the status delay
+// before the link reading is treated as bogus for that frame
+#define LATENCY_LINK_MAX_DEVIATION_US 10000
+
+extern int latency_source_mode;
+
+// Enable status timestamps in the software parameters and pick the source
+// to use. Call after the hardware parameters are committed and before the
+// software parameters are. Returns the active source.
+int latency_configure(snd_pcm_t *pcm, snd_pcm_hw_params_t *hw_params, snd_pcm_sw_params_t *sw_params);
+
+// Read the output delay and the CLOCK_REALTIME instant it applies to
+void latency_measure(snd_pcm_t *pcm, unsigned int sample_rate, struct timespec *ts, int64_t *delay_us);
+
+// Keep the written sample position used by the link sources in step with
+// the stream. Reset whenever the PCM is prepared again.
+void latency_frames_committed(snd_pcm_uframes_t frames);
+void latency_stream_reset(void);
+
+int latency_active_source(void);
+const char *latency_source_name(int source);
+
+#endif // LTC_LATENCY_H
@@ -1,5 +1,7 @@
 #include "ltc_ntp.h"
 #include "ltc_common.h"
+#include "ltc_seqlock.h"
+#include "ltc_state.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,16 +9,56 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <netdb.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
 #include <time.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 
 // Global variables
 char ntp_server[256] = "";
-int64_t ntp_adjustment_step_us = 0;
 int ntp_sync_interval = 60;     // Default sync interval in seconds (1 minute)
 int ntp_slew_period = 30;       // Period over which to smear time adjustments in seconds
+char ntp_status_file[256] = "";
+
+// Correction written by the sync thread, read by the frame renderer and xrun recovery
+static seqlock_t correction_lock;
+SEQLOCK_RECORD(clock_correction_t);
+
+void ntp_publish_correction(const clock_correction_t *correction) {
+    seqlock_write(&correction_lock, correction, sizeof(*correction));
+}
+
+// Wait-free snapshot for the time-critical readers. Returns -1 and leaves
+// *correction untouched if the sync thread is mid-publish, in which case
+// the caller keeps using its previous snapshot for this frame.
+int ntp_try_read_correction(clock_correction_t *correction) {
+    return seqlock_try_read(&correction_lock, correction, sizeof(*correction));
+}
+
+int64_t monotonic_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * MICROSECONDS_PER_SECOND + ts.tv_nsec / NANOSECONDS_PER_MICROSECOND;
+}
+
+int64_t ntp_correction_now(clock_correction_t *snapshot) {
+    ntp_try_read_correction(snapshot);
+    return clock_correction_at(snapshot, monotonic_now_us());
+}
+
+// The correction curve evaluated now, for threads other than the one
+// rendering frames
+int64_t ntp_applied_offset(void) {
+    clock_correction_t correction;
+    seqlock_read(&correction_lock, &correction, sizeof(correction));
+    return clock_correction_at(&correction, monotonic_now_us());
+}
 
 // Convert NTP format timestamp to Unix microseconds
 int64_t ntp_to_unix_us(uint32_t ntp_sec, uint32_t ntp_frac) {
@@ -29,222 +71,712 @@ int64_t ntp_to_unix_us(uint32_t ntp_sec, uint32_t ntp_frac) {
     return (unix_sec * MICROSECONDS_PER_SECOND) + us;
 }
 
+static void timespec_to_ntp(const struct timespec *ts, uint32_t *sec, uint32_t *frac) {
+    *sec = (uint32_t)(ts->tv_sec + NTP_TIMESTAMP_DELTA);
+    *frac = (uint32_t)((((uint64_t)ts->tv_nsec) << 32) / 1000000000LL);
+}
+
+static int64_t timespec_to_us(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * MICROSECONDS_PER_SECOND + ts->tv_nsec / NANOSECONDS_PER_MICROSECOND;
+}
+
 // Get current system time in NTP format
 void get_system_time_ntp(uint32_t *sec, uint32_t *frac) {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
-    
-    *sec = (uint32_t)(ts.tv_sec + NTP_TIMESTAMP_DELTA);
-    *frac = (uint32_t)((((uint64_t)ts.tv_nsec) << 32) / 1000000000LL);
+    timespec_to_ntp(&ts, sec, frac);
 }
 
-// Perform a single NTP query and return the offset
-int64_t perform_single_ntp_query(const char *hostname, int sockfd, struct sockaddr_in *server_addr) {
-    ntp_packet packet = {0};
+// Fill in a client request stamped with the current system time, which is
+// also returned in *tx_time as the fallback T1
+static void ntp_build_request(ntp_packet *packet, struct timespec *tx_time) {
+    memset(packet, 0, sizeof(*packet));
     
     // Set up NTP packet - Request version 4, mode client (3)
-    packet.li_vn_mode = 0x23;  // LI = 0, VN = 4, Mode = 3
+    packet->li_vn_mode = 0x23;  // LI = 0, VN = 4, Mode = 3
     
     // Record client transmit timestamp
     uint32_t tx_sec, tx_frac;
-    struct timespec client_send_ts;
-    
-    // Get precise timestamp before sending
-    clock_gettime(CLOCK_REALTIME, &client_send_ts);
-    
-    get_system_time_ntp(&tx_sec, &tx_frac);
-    packet.tx_ts_sec = htonl(tx_sec);
-    packet.tx_ts_frac = htonl(tx_frac);
-    
-    // Send request to server
-    if (sendto(sockfd, &packet, sizeof(ntp_packet), 0, 
-               (struct sockaddr *)server_addr, sizeof(*server_addr)) < 0) {
-        perror("Error sending to NTP server");
-        return INT64_MAX; // Signal error with large value
-    }
-    
-    // Receive response from server
-    socklen_t addr_len = sizeof(*server_addr);
-    struct timespec client_recv_ts;
-    
-    if (recvfrom(sockfd, &packet, sizeof(ntp_packet), 0, 
-                 (struct sockaddr *)server_addr, &addr_len) < 0) {
-        perror("Error receiving from NTP server");
-        return INT64_MAX; // Signal error with large value
-    }
-    
-    // Get client receive timestamp immediately after receiving response
-    clock_gettime(CLOCK_REALTIME, &client_recv_ts);
-    
-    // Convert NTP data from network byte order
-    packet.tx_ts_sec = ntohl(packet.tx_ts_sec);
-    packet.tx_ts_frac = ntohl(packet.tx_ts_frac);
-    packet.recv_ts_sec = ntohl(packet.recv_ts_sec);
-    packet.recv_ts_frac = ntohl(packet.recv_ts_frac);
-    
-    // Calculate server transmit time in Unix microseconds
-    int64_t server_tx_us = ntp_to_unix_us(packet.tx_ts_sec, packet.tx_ts_frac);
-    
-    // Calculate client receive time in Unix microseconds
-    int64_t client_recv_us = (int64_t)client_recv_ts.tv_sec * MICROSECONDS_PER_SECOND + 
-                            client_recv_ts.tv_nsec / NANOSECONDS_PER_MICROSECOND;
-    
-    // Calculate offset: server_time - client_time
-    return server_tx_us - client_recv_us;
+    clock_gettime(CLOCK_REALTIME, tx_time);
+    timespec_to_ntp(tx_time, &tx_sec, &tx_frac);
+    packet->tx_ts_sec = htonl(tx_sec);
+    packet->tx_ts_frac = htonl(tx_frac);
 }
 
-// Query NTP server multiple times and use the shortest offset to reduce network latency impact
-int query_ntp_server(const char *hostname) {
-    int sockfd;
-    struct sockaddr_in server_addr;
-    struct hostent *server;
-    struct timeval tv_timeout;
-    
-    // Set up timeout (5 seconds)
-    tv_timeout.tv_sec = 5;
-    tv_timeout.tv_usec = 0;
-    
-    // Create UDP socket
-    sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sockfd < 0) {
-        perror("Error creating socket");
-        return -1;
+const char *ntp_ts_source_name(int source) {
+    return source == NTP_TS_KERNEL ? "kernel" : "user";
+}
+
+// Have the kernel timestamp the socket's traffic in software as it passes
+// the network stack: receive times as control messages on each datagram,
+// transmit times on the error queue. Kernels without SO_TIMESTAMPING still
+// get receive times from SO_TIMESTAMPNS. Whatever is missing falls back to
+// clock_gettime next to the syscall, per packet.
+static void ntp_enable_timestamps(int sockfd) {
+    static int warned;
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+                SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+        return;
     }
-    
-    // Set socket timeout
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv_timeout, sizeof(tv_timeout)) < 0) {
-        perror("Error setting socket timeout");
-        close(sockfd);
-        return -1;
+    int on = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0) {
+        return;
     }
-    
-    // Get server by name or IP
-    server = gethostbyname(hostname);
-    if (server == NULL) {
-        fprintf(stderr, "Error resolving NTP server: %s\n", hostname);
-        close(sockfd);
-        return -1;
+    if (!warned) {
+        fprintf(stderr, "Warning: No kernel timestamps on the NTP socket, using clock_gettime\n");
+        warned = 1;
     }
-    
-    // Set up server address
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    memcpy(&server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    server_addr.sin_port = htons(NTP_PORT);
-    
-    // Perform multiple queries and select the smallest offset
-    int64_t min_offset = 0;
-    int successful_queries = 0;
-    int64_t sum_offset = 0;
-    
-    // Store all successful offsets for processing
-    int64_t offsets[NTP_QUERY_COUNT];
-    
-    for (int i = 0; i < NTP_QUERY_COUNT; i++) {
-        // Initialize to error value
-        offsets[i] = INT64_MAX;
-        
-        // Perform the query
-        int64_t offset = perform_single_ntp_query(hostname, sockfd, &server_addr);
-        
-        // Check if query was successful
-        if (offset != INT64_MAX) {
-            // Sanity check - ignore obviously wrong values (more than ±10 seconds)
-            if (labs(offset) < NTP_ERROR_THRESHOLD) {
-                offsets[i] = offset;
-                successful_queries++;
-                sum_offset += offset;
-            }
-            
-            // Sleep between queries to avoid flooding server
-            if (i < NTP_QUERY_COUNT - 1) {
-                usleep(NTP_QUERY_INTERVAL);
+}
+
+// Software timestamp in a message's control data. Returns -1 if none.
+static int ntp_cmsg_timestamp(struct msghdr *msg, struct timespec *ts) {
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if (cm->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cm), sizeof(stamps));
+            if (stamps.ts[0].tv_sec != 0 || stamps.ts[0].tv_nsec != 0) {
+                *ts = stamps.ts[0];
+                return 0;
             }
+        } else if (cm->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(ts, CMSG_DATA(cm), sizeof(*ts));
+            return 0;
         }
     }
-    
-    // If we have successful queries, find the smallest valid offset
-    if (successful_queries > 0) {
-        // Start with average as fallback
-        min_offset = sum_offset / successful_queries;
-        
-        // Then look for the minimum absolute offset 
-        for (int i = 0; i < NTP_QUERY_COUNT; i++) {
-            if (offsets[i] != INT64_MAX && labs(offsets[i]) < labs(min_offset)) {
-                min_offset = offsets[i];
-            }
+    return -1;
+}
+
+// Receive one datagram and its receive time (T4), the kernel's if it stamped
+// the packet. Returns the recvmsg result.
+static ssize_t ntp_recv(int sockfd, ntp_packet *packet, struct timespec *rx_time, int *rx_source) {
+    char control[256];
+    struct iovec iov = { packet, sizeof(*packet) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(sockfd, &msg, 0);
+    // Fallback: the time recvmsg returned
+    clock_gettime(CLOCK_REALTIME, rx_time);
+    *rx_source = NTP_TS_USER;
+    if (n >= 0 && ntp_cmsg_timestamp(&msg, rx_time) == 0) {
+        *rx_source = NTP_TS_KERNEL;
+    }
+    return n;
+}
+
+// Drain the transmit timestamps queued on the socket's error queue into
+// *tx_time. Only one query is ever in flight, so the newest belongs to it.
+// Returns -1 if the queue held none.
+static int ntp_drain_tx_timestamps(int sockfd, struct timespec *tx_time) {
+    int found = -1;
+    for (;;) {
+        char control[256];
+        char data[sizeof(ntp_packet)];
+        struct iovec iov = { data, sizeof(data) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return found;
+        }
+        if (ntp_cmsg_timestamp(&msg, tx_time) == 0) {
+            found = 0;
         }
     }
-    
-    // Close socket
-    close(sockfd);
-    
-    // If no successful queries, return error
-    if (successful_queries == 0) {
+}
+
+// Turn a reply into a sample from its four timestamps. The origin timestamp
+// is only our own transmit stamp echoed back; T1 is taken from tx_time, which
+// may be the kernel's more precise send time. Returns -1 for replies that
+// carry no usable time.
+static int ntp_reply_sample(ntp_packet *packet, const struct timespec *tx_time,
+                            const struct timespec *rx_time, ntp_sample_t *sample) {
+    // Only server replies from a synchronised server (LI 3 is an unsynchronised
+    // clock, stratum 0 a kiss-o'-death) with a transmit time
+    if ((packet->li_vn_mode & 0x07) != 4 || (packet->li_vn_mode >> 6) == 3 ||
+        packet->stratum == 0 || packet->stratum > 15 ||
+        (packet->tx_ts_sec == 0 && packet->tx_ts_frac == 0)) {
         return -1;
     }
-    
-    // Update target offset with mutex protection
-    pthread_mutex_lock(&ntp_lock);
-    
-    // Set target offset to the new NTP time offset (the minimum value found)
+
+    // T1..T4, all in Unix microseconds
+    int64_t t1 = timespec_to_us(tx_time);
+    int64_t t2 = ntp_to_unix_us(ntohl(packet->recv_ts_sec), ntohl(packet->recv_ts_frac));
+    int64_t t3 = ntp_to_unix_us(ntohl(packet->tx_ts_sec), ntohl(packet->tx_ts_frac));
+    int64_t t4 = timespec_to_us(rx_time);
+
+    ntp_sample_init(sample, t1, t2, t3, t4, (int8_t)packet->precision);
+    // Sanity check - ignore obviously wrong values (more than ±10 seconds)
+    return llabs(sample->offset_us) < NTP_ERROR_THRESHOLD ? 0 : -1;
+}
+
+// Root delay and dispersion: NTP short format, 16.16 seconds
+static int64_t ntp_short_to_us(uint32_t value) {
+    return ((int64_t)ntohl(value) * MICROSECONDS_PER_SECOND) >> 16;
+}
+
+// Feed an offset measured at sample_us to the discipline and publish the
+// correction curve it gives. Returns -1 if the offset is beyond
+// NTP_ERROR_THRESHOLD.
+static int ntp_apply_offset(ntp_client_t *c, int64_t offset_us, int64_t sample_us) {
     // Double-check that the offset is reasonable before applying it
-    if (labs(min_offset) < NTP_ERROR_THRESHOLD) {
-        ntp_target_offset_us = min_offset;
-    } else {
+    if (llabs(offset_us) >= NTP_ERROR_THRESHOLD) {
         // Log extreme values but don't apply them
-        fprintf(stderr, "Warning: Ignoring extreme NTP offset value: %" PRId64 " microseconds\n", min_offset);
-        pthread_mutex_unlock(&ntp_lock);
+        fprintf(stderr, "Warning: Ignoring extreme NTP offset value: %" PRId64 " microseconds\n", offset_us);
         return -1; // Consider this a failed sync
     }
-    
-    // Calculate how much to adjust per frame to reach target over slew period
-    // Use the actual frame rate from the shared global variable if available
-    // This is set in the main program based on the selected frame rate
-    extern double selected_fps;  // Declare the external variable
-    
-    // Calculate number of frames over which to apply the adjustment
-    int64_t adjust_frames = (int64_t)(ntp_slew_period * selected_fps);
-    
-    // Calculate adjustment per frame (how much to add to offset each frame)
-    int64_t diff = ntp_target_offset_us - ntp_offset_us;
-    if (adjust_frames > 0) {
-        ntp_adjustment_step_us = diff / adjust_frames;
-        // Ensure we have at least some adjustment if diff is small
-        if (diff != 0 && ntp_adjustment_step_us == 0) {
-            ntp_adjustment_step_us = (diff > 0) ? 1 : -1;
+    ntp_target_offset_us = offset_us;
+    
+    // The filters may still prefer a sample the discipline has already had,
+    // in which case the current curve carries on. The blocking initial sync
+    // runs before any output, so it steps rather than slews.
+    if (discipline_update(&c->discipline, offset_us, sample_us, monotonic_now_us(),
+                          c->blocking ? 0 : ntp_slew_period) == 0) {
+        ntp_publish_correction(&c->discipline.correction);
+    }
+    return 0;
+}
+
+// Write a sync's report to ntp_status_file as key=value lines, replacing it
+// atomically. resolve_us is the slowest of the servers' last lookups.
+static void ntp_write_status(const ntp_report_t *r, int64_t resolve_us) {
+    char tmp[sizeof(ntp_status_file) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", ntp_status_file);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        perror("Error writing NTP status file");
+        return;
+    }
+    const clock_discipline_t *d = &r->discipline;
+    const ntp_selection_t *sel = &r->selection;
+    fprintf(f, "time=%ld\n", (long)r->time_s);
+    fprintf(f, "state=%s\n", discipline_state_name(d->state));
+    fprintf(f, "updates=%lu\n", d->updates);
+    fprintf(f, "offset_us=%" PRId64 "\n", d->offset_us);
+    fprintf(f, "residual_us=%" PRId64 "\n", d->residual_us);
+    fprintf(f, "residual_rms_us=%.1f\n", d->residual_rms_us);
+    fprintf(f, "frequency_ppm=%.3f\n", d->correction.freq_ppb / 1000.0);
+    fprintf(f, "wander_ppm=%.3f\n", d->wander_ppb / 1000.0);
+    fprintf(f, "correction_us=%" PRId64 "\n", clock_correction_at(&d->correction, r->mono_us));
+    fprintf(f, "sample_age_s=%.1f\n", (r->mono_us - d->sample_us) / (double)MICROSECONDS_PER_SECOND);
+    fprintf(f, "servers=%d\n", r->servers);
+    fprintf(f, "survivors=%d\n", sel->survivors);
+    fprintf(f, "system_peer=%s\n", r->system_peer);
+    fprintf(f, "error_bound_us=%" PRId64 "\n", sel->distance_us);
+    fprintf(f, "jitter_us=%" PRId64 "\n", sel->jitter_us);
+    fprintf(f, "sync_latency_us=%" PRId64 "\n", r->sync_latency_us);
+    fprintf(f, "resolve_latency_us=%" PRId64 "\n", resolve_us);
+    if (fclose(f) != 0 || rename(tmp, ntp_status_file) != 0) {
+        perror("Error writing NTP status file");
+    }
+}
+
+static int64_t ntp_resolve_latency(const ntp_resolver_t *r) {
+    int64_t resolve_us = 0;
+    for (int i = 0; i < r->count; i++) {
+        if (r->entry[i].latency_us > resolve_us) resolve_us = r->entry[i].latency_us;
+    }
+    return resolve_us;
+}
+
+static void ntp_write_report(const ntp_report_t *r, int64_t resolve_us) {
+    if (ntp_status_file[0] != 0) {
+        ntp_write_status(r, resolve_us);
+    }
+    if (r->save_state) {
+        state_write(&r->state);
+    }
+}
+
+// Resolver thread: write the report the last sync posted, without the lock
+static void ntp_client_write_report(ntp_resolver_t *r, void *ctx) {
+    const ntp_client_t *c = (const ntp_client_t*)ctx;
+    ntp_report_t report = c->report;
+    int64_t resolve_us = ntp_resolve_latency(r);
+    pthread_mutex_unlock(&r->lock);
+    ntp_write_report(&report, resolve_us);
+    pthread_mutex_lock(&r->lock);
+}
+
+static void ntp_client_fill_report(const ntp_client_t *c, ntp_report_t *r) {
+    r->mono_us = monotonic_now_us();
+    r->time_s = (int64_t)time(NULL);
+    r->discipline = c->discipline;
+    r->selection = c->selection;
+    r->system_peer = c->peers[c->selection.system_peer].name;
+    r->servers = c->num_peers;
+    r->sync_latency_us = c->sync_latency_us;
+    r->save_state = c->state_due;
+    if (c->state_due) {
+        state_copy(&r->state);
+    }
+}
+
+// Hand the sync's report to the resolver thread. If that thread is busy,
+// this report is skipped and the next sync's written instead, with the
+// state save if one was due; without the thread it is written here.
+static void ntp_client_post_report(ntp_client_t *c) {
+    if (state_note_clock(&c->discipline)) {
+        c->state_due = 1;
+    }
+    if (ntp_status_file[0] == 0 && !c->state_due) {
+        return;
+    }
+    if (ntp_resolver_post_begin(&c->resolver) == 0) {
+        ntp_client_fill_report(c, &c->report);
+        ntp_resolver_post_end(&c->resolver);
+        c->state_due = 0;
+    } else if (!c->resolver.started) {
+        ntp_report_t report;
+        ntp_client_fill_report(c, &report);
+        ntp_write_report(&report, ntp_resolve_latency(&c->resolver));
+        c->state_due = 0;
+    }
+}
+
+// Connect peer i's socket to its current address. The socket is reused
+// for an address of the same family, and replaced, in the epoll set too,
+// for the other family. Returns -1 if the peer is left without a socket.
+static int ntp_peer_connect(ntp_client_t *c, int i) {
+    ntp_peer_t *p = &c->peers[i];
+    if (p->sock >= 0 && connect(p->sock, (struct sockaddr *)&p->addr, p->addr_len) == 0) {
+        return 0;
+    }
+    if (p->sock >= 0) {
+        epoll_ctl(c->fd, EPOLL_CTL_DEL, p->sock, NULL);
+        close(p->sock);
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = (uint32_t)i;
+    p->sock = socket(p->addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (p->sock < 0 ||
+        connect(p->sock, (struct sockaddr *)&p->addr, p->addr_len) < 0 ||
+        epoll_ctl(c->fd, EPOLL_CTL_ADD, p->sock, &ev) < 0) {
+        fprintf(stderr, "Error creating NTP socket for %s: %s\n", p->name, strerror(errno));
+        if (p->sock >= 0) close(p->sock);
+        p->sock = -1;
+        return -1;
+    }
+    ntp_enable_timestamps(p->sock);
+    return 0;
+}
+
+// Take up addresses the resolver thread has found since the last sync. A
+// server at a new address is a new server, so its filter starts empty.
+static void ntp_client_update_addresses(ntp_client_t *c) {
+    for (int i = 0; i < c->num_peers; i++) {
+        ntp_peer_t *p = &c->peers[i];
+        int had_address = p->addr_len > 0;
+        // Silent for a full filter's worth of rounds: try the name's next address
+        int failover = 0;
+        if (p->silent_rounds >= NTP_FILTER_STAGES && ntp_resolver_next(&c->resolver, i)) {
+            failover = 1;
+            p->silent_rounds = 0;
         }
+        if (!ntp_resolver_get(&c->resolver, i, &p->addr, &p->addr_len, &p->addr_generation)) {
+            continue;
+        }
+        if (had_address) {
+            char text[INET6_ADDRSTRLEN];
+            ntp_address_text(&p->addr, text, sizeof(text));
+            if (failover) {
+                fprintf(stderr, "NTP server %s silent, trying %s\n", p->name, text);
+            } else {
+                fprintf(stderr, "NTP server %s now resolves to %s\n", p->name, text);
+            }
+            memset(&p->filter, 0, sizeof(p->filter));
+            p->reach = 0;
+        }
+        p->silent_rounds = 0;
+        ntp_peer_connect(c, i);
     }
-    
-    pthread_mutex_unlock(&ntp_lock);
-    
+}
+
+// Sync and name resolution latency over the run
+void ntp_report_stats(ntp_client_t *c) {
+    ntp_resolver_t *r = &c->resolver;
+    pthread_mutex_lock(&r->lock);
+    printf("NTP: %lu syncs, %.1f ms from query to result on average (%.1f ms worst); "
+           "%lu DNS lookups, %.1f ms on average (%.1f ms worst), %lu failed, %lu address changes, "
+           "%lu failovers\n",
+           c->syncs, c->syncs ? c->sync_total_us / 1000.0 / c->syncs : 0.0, c->sync_max_us / 1000.0,
+           r->lookups, r->lookups ? r->total_us / 1000.0 / r->lookups : 0.0, r->max_us / 1000.0,
+           r->failures, r->changes, r->failovers);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// Print the accepted offset and the selection behind it
+void ntp_report_sync(const ntp_client_t *c) {
+    const ntp_selection_t *sel = &c->selection;
+    const ntp_peer_t *p = &c->peers[sel->system_peer];
+    const clock_discipline_t *d = &c->discipline;
+    printf(" NTP sync successful with %d of %d servers (system peer %s), target offset: %" PRId64
+           " microseconds (error bound %" PRId64 ", jitter %" PRId64 ", delay %" PRId64 " us,"
+           " timestamps tx %s rx %s; discipline %s, residual %" PRId64 " us, frequency %+.3f ppm)\n",
+           sel->survivors, c->num_peers, p->name, ntp_target_offset_us, sel->distance_us,
+           sel->jitter_us, p->filter.delay_us,
+           ntp_ts_source_name(p->filter.tx_source), ntp_ts_source_name(p->filter.rx_source),
+           discipline_state_name(d->state), d->residual_us, d->correction.freq_ppb / 1000.0);
+}
+
+//---------- Non-blocking multi-server client ----------//
+
+static void ntp_client_arm(ntp_client_t *c, int64_t us) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = us / MICROSECONDS_PER_SECOND;
+    its.it_value.tv_nsec = (us % MICROSECONDS_PER_SECOND) * NANOSECONDS_PER_MICROSECOND;
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+        its.it_value.tv_nsec = 1; // Zero would disarm the timer
+    }
+    timerfd_settime(c->timer, 0, &its, NULL);
+}
+
+// Select among the servers' clock filters and combine the survivors.
+// Returns -1 if no majority of the servers heard from agree.
+static int ntp_client_apply(ntp_client_t *c) {
+    ntp_candidate_t cand[NTP_MAX_SERVERS];
+    int n = 0;
+    for (int i = 0; i < c->num_peers; i++) {
+        ntp_peer_t *p = &c->peers[i];
+        p->status = -1;
+        // Servers silent for the last eight rounds are out
+        if (p->reach == 0 || ntp_filter_select(&p->filter) < 0) {
+            continue;
+        }
+        int64_t distance = ntp_root_distance(p->root_delay_us, p->root_dispersion_us,
+                                             p->filter.delay_us, p->filter.dispersion_us,
+                                             p->filter.jitter_us);
+        if (distance >= NTP_MAX_DISTANCE_US) {
+            continue;
+        }
+        cand[n].offset_us = p->filter.offset_us;
+        cand[n].distance_us = distance;
+        cand[n].jitter_us = p->filter.jitter_us;
+        cand[n].peer = i;
+        n++;
+    }
+
+    ntp_selection_t selection;
+    if (ntp_select(cand, n, &selection) < 0) {
+        if (n > 0) {
+            fprintf(stderr, "No majority among %d NTP servers\n", n);
+        }
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        ntp_peer_t *p = &c->peers[cand[i].peer];
+        p->status = cand[i].status;
+        if (p->status == NTP_CAND_FALSETICKER) {
+            fprintf(stderr, "Warning: Ignoring NTP server %s, offset %" PRId64
+                    " microseconds disagrees with the majority\n", p->name, cand[i].offset_us);
+        }
+    }
+    // The combined offset is as of the system peer's sample
+    const ntp_peer_t *sys = &c->peers[selection.system_peer];
+    if (ntp_apply_offset(c, selection.offset_us, sys->filter.time_us) < 0) {
+        return -1;
+    }
+    c->selection = selection;
+    ntp_client_post_report(c);
     return 0;
 }
 
-// Thread function for periodic NTP synchronization
-void* ntp_sync_thread(void *arg) {
-    ntp_thread_args_t *args = (ntp_thread_args_t*)arg;
-    const char *server = args->server;
-    int display_enabled = args->display_enabled;
-    
-    while (running) {
-        // Sleep for configured interval before next sync
-        for (int i = 0; i < ntp_sync_interval && running; i++) {
-            sleep(1);
+// Every query of the round answered or timed out: next burst round, or
+// select and apply
+static void ntp_client_end_round(ntp_client_t *c) {
+    for (int i = 0; i < c->num_peers; i++) {
+        ntp_peer_t *p = &c->peers[i];
+        if (p->waiting) {
+            fprintf(stderr, "Error receiving from NTP server %s: timed out\n", p->name);
+            p->waiting = 0;
         }
+    }
+    c->waiting = 0;
 
-        // Query NTP server
-        if (query_ntp_server(server) == 0) {
+    if (--c->rounds > 0) {
+        c->state = NTP_CLIENT_WAIT_NEXT;
+        ntp_client_arm(c, NTP_QUERY_INTERVAL);
+        return;
+    }
+
+    // The initial burst's time is mostly its deliberate spacing
+    if (c->round == 1) {
+        c->sync_latency_us = monotonic_now_us() - c->sync_start_us;
+        c->sync_total_us += c->sync_latency_us;
+        if (c->sync_latency_us > c->sync_max_us) c->sync_max_us = c->sync_latency_us;
+        c->syncs++;
+    }
+    c->status = ntp_client_apply(c);
+    if (!c->blocking) {
+        if (c->status == 0) {
             // Only show sync message if we're in interactive mode (not quiet)
-            if (display_enabled) {
-                printf(" NTP sync successful with server %s, target offset: %" PRId64 " microseconds\n", 
-                    server, ntp_target_offset_us);
+            if (c->display_enabled) {
+                ntp_report_sync(c);
             }
         } else {
-            fprintf(stderr, "NTP sync failed with server %s\n", server);
+            fprintf(stderr, "NTP sync failed\n");
+        }
+    }
+    c->state = NTP_CLIENT_IDLE;
+    ntp_client_arm(c, (int64_t)ntp_sync_interval * MICROSECONDS_PER_SECOND);
+}
+
+// One query to every server at once. A server that missed the first round
+// of a burst is left out of the rest, so it cannot hold up every round.
+static void ntp_client_send_round(ntp_client_t *c) {
+    if (c->round == 0) {
+        ntp_client_update_addresses(c);
+        c->sync_start_us = monotonic_now_us();
+    }
+    c->waiting = 0;
+    for (int i = 0; i < c->num_peers; i++) {
+        ntp_peer_t *p = &c->peers[i];
+        ntp_packet packet;
+
+        if (p->sock < 0 || (c->round > 0 && p->reach == 0)) {
+            continue;
         }
+        p->reach <<= 1;
+        p->silent_rounds++;
+        // Stale transmit stamps from an earlier, timed out query
+        ntp_drain_tx_timestamps(p->sock, &p->tx_time);
+        ntp_build_request(&packet, &p->tx_time);
+        p->tx_ts_sec = packet.tx_ts_sec;
+        p->tx_ts_frac = packet.tx_ts_frac;
+        p->tx_source = NTP_TS_USER;
+
+        if (send(p->sock, &packet, sizeof(ntp_packet), 0) < 0) {
+            fprintf(stderr, "Error sending to NTP server %s: %s\n", p->name, strerror(errno));
+            continue;
+        }
+        p->waiting = 1;
+        c->waiting++;
+    }
+    c->round++;
+
+    if (c->waiting == 0) {
+        ntp_client_end_round(c);
+        return;
     }
+    c->state = NTP_CLIENT_WAIT_REPLY;
+    ntp_client_arm(c, NTP_REPLY_TIMEOUT_US);
+}
+
+// Called for readable data and for the error queue, where the kernel
+// queues transmit timestamps; both are drained so the socket stops polling
+// ready.
+static void ntp_peer_on_reply(ntp_client_t *c, ntp_peer_t *p) {
+    ntp_packet packet;
+    struct timespec rx_time;
+    int rx_source;
+
+    if (ntp_drain_tx_timestamps(p->sock, &p->tx_time) == 0) {
+        p->tx_source = NTP_TS_KERNEL;
+    }
+
+    for (;;) {
+        ssize_t n = ntp_recv(p->sock, &packet, &rx_time, &rx_source);
+        if (n < 0) {
+            return; // Drained
+        }
+
+        // Drop short packets and late replies to queries that already timed out
+        if (n < (ssize_t)sizeof(packet) || !p->waiting ||
+            packet.orig_ts_sec != p->tx_ts_sec || packet.orig_ts_frac != p->tx_ts_frac) {
+            continue;
+        }
+
+        // Normally already drained on the error queue's own wakeup
+        if (ntp_drain_tx_timestamps(p->sock, &p->tx_time) == 0) {
+            p->tx_source = NTP_TS_KERNEL;
+        }
+        ntp_sample_t sample;
+        if (ntp_reply_sample(&packet, &p->tx_time, &rx_time, &sample) == 0) {
+            sample.tx_source = p->tx_source;
+            sample.rx_source = rx_source;
+            ntp_filter_add(&p->filter, &sample);
+            p->root_delay_us = ntp_short_to_us(packet.root_delay);
+            p->root_dispersion_us = ntp_short_to_us(packet.root_dispersion);
+            p->reach |= 1;
+            p->silent_rounds = 0;
+        }
+        p->waiting = 0;
+        c->waiting--;
+    }
+}
+
+int ntp_client_open(ntp_client_t *c, const char *servers, int display_enabled, int cpu_core) {
+    memset(c, 0, sizeof(*c));
+    c->display_enabled = display_enabled;
+    c->status = -1;
+    c->state = NTP_CLIENT_IDLE;
+    discipline_init(&c->discipline);
+    ntp_resolver_init(&c->resolver);
+    ntp_resolver_set_job(&c->resolver, ntp_client_write_report, c);
+    strncpy(c->names, servers, sizeof(c->names) - 1);
+
+    c->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    c->fd = epoll_create1(EPOLL_CLOEXEC);
+    if (c->timer < 0 || c->fd < 0) {
+        perror("Error creating NTP client");
+        ntp_client_close(c);
+        return -1;
+    }
+
+    // Resolve once up front, before any output; from then on only the
+    // resolver thread waits on DNS. A name that does not resolve yet keeps
+    // its place and joins once the resolver thread gets an address.
+    int resolved = 0;
+    char *save = NULL;
+    for (char *name = strtok_r(c->names, ", \t", &save); name != NULL;
+         name = strtok_r(NULL, ", \t", &save)) {
+        if (c->num_peers == NTP_MAX_SERVERS) {
+            fprintf(stderr, "Warning: Only the first %d NTP servers are used\n", NTP_MAX_SERVERS);
+            break;
+        }
+        int i = ntp_resolver_add(&c->resolver, name);
+        ntp_peer_t *p = &c->peers[i];
+        memset(p, 0, sizeof(*p));
+        p->name = name;
+        p->sock = -1;
+        p->status = -1;
+        c->num_peers++;
+        if (ntp_resolver_lookup(&c->resolver, i) == 0) {
+            ntp_resolver_get(&c->resolver, i, &p->addr, &p->addr_len, &p->addr_generation);
+            if (ntp_peer_connect(c, i) == 0) {
+                resolved++;
+            }
+        }
+    }
+
+    if (c->num_peers == 0) {
+        fprintf(stderr, "No NTP server in: %s\n", servers);
+        ntp_client_close(c);
+        return -1;
+    }
+    if (resolved == 0) {
+        fprintf(stderr, "Warning: No NTP server reachable yet, retrying in the background\n");
+    }
+    ntp_resolver_start(&c->resolver, cpu_core);
+    return 0;
+}
+
+// Wait up to timeout_ms for the client's descriptors and handle them.
+// Returns -1 on a poll error other than EINTR.
+static int ntp_client_poll(ntp_client_t *c, int timeout_ms) {
+    struct pollfd fds[2];
+    fds[0].fd = c->timer;
+    fds[0].events = POLLIN;
+    fds[1].fd = c->fd;
+    fds[1].events = POLLIN;
+    int n = poll(fds, 2, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (fds[1].revents) {
+        ntp_client_on_reply(c);
+    }
+    if (fds[0].revents) {
+        ntp_client_on_timer(c);
+    }
+    return 0;
+}
+
+void ntp_client_restore(ntp_client_t *c, int32_t freq_ppb, int64_t offset_us) {
+    discipline_restore(&c->discipline, freq_ppb, offset_us, monotonic_now_us(), ntp_slew_period);
+    ntp_target_offset_us = offset_us;
+    ntp_publish_correction(&c->discipline.correction);
+}
+
+void ntp_client_start(ntp_client_t *c) {
+    c->rounds = NTP_BURST_ROUNDS;
+    c->round = 0;
+    ntp_client_send_round(c);
+}
+
+int ntp_client_sync(ntp_client_t *c) {
+    c->blocking = 1;
+    ntp_client_start(c);
+    while (running && c->state != NTP_CLIENT_IDLE) {
+        if (ntp_client_poll(c, -1) < 0) {
+            perror("NTP client");
+            break;
+        }
+    }
+    c->blocking = 0;
+    return c->state == NTP_CLIENT_IDLE ? c->status : -1;
+}
+
+void ntp_client_on_timer(ntp_client_t *c) {
+    uint64_t expirations;
+    if (read(c->timer, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+
+    switch (c->state) {
+    case NTP_CLIENT_IDLE:
+        c->rounds = 1;
+        c->round = 0;
+        ntp_client_send_round(c);
+        break;
+    case NTP_CLIENT_WAIT_NEXT:
+        ntp_client_send_round(c);
+        break;
+    case NTP_CLIENT_WAIT_REPLY:
+        ntp_client_end_round(c);
+        break;
+    }
+}
+
+void ntp_client_on_reply(ntp_client_t *c) {
+    struct epoll_event events[NTP_MAX_SERVERS];
+    int n = epoll_wait(c->fd, events, NTP_MAX_SERVERS, 0);
+    for (int i = 0; i < n; i++) {
+        ntp_peer_on_reply(c, &c->peers[events[i].data.u32]);
+    }
+    // The round ends as soon as the last server answers
+    if (c->state == NTP_CLIENT_WAIT_REPLY && c->waiting == 0) {
+        ntp_client_end_round(c);
+    }
+}
+
+void ntp_client_close(ntp_client_t *c) {
+    ntp_resolver_stop(&c->resolver);
+    for (int i = 0; i < c->num_peers; i++) {
+        if (c->peers[i].sock >= 0) close(c->peers[i].sock);
+        c->peers[i].sock = -1;
+    }
+    if (c->fd >= 0) close(c->fd);
+    if (c->timer >= 0) close(c->timer);
+    c->fd = -1;
+    c->timer = -1;
+}
+
+// Thread function for periodic NTP synchronization: runs the client opened
+// and initially synced by main, checking for shutdown once a second
+void* ntp_sync_thread(void *arg) {
+    ntp_client_t *c = (ntp_client_t*)arg;
     
-    free(arg); // Free allocated thread args
+    while (running) {
+        if (ntp_client_poll(c, 1000) < 0) {
+            perror("NTP client");
+            break;
+        }
+    }
     return NULL;
-}
\ No newline at end of file
+}
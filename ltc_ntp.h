@@ -5,13 +5,21 @@
 #include <inttypes.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <time.h>
 #include "ltc_common.h"
+#include "ltc_ntp_filter.h"
+#include "ltc_ntp_select.h"
+#include "ltc_discipline.h"
+#include "ltc_ntp_resolve.h"
+#include "ltc_state.h"
 
 #define NTP_PORT 123
 #define NTP_TIMESTAMP_DELTA 2208988800LL // Seconds between 1900 (NTP epoch) and 1970 (Unix epoch)
-#define NTP_QUERY_COUNT 5   // Number of NTP queries to perform for each sync
-#define NTP_QUERY_INTERVAL 200000 // Microseconds between queries (200ms)
+#define NTP_MAX_SERVERS NTP_RESOLVE_MAX_NAMES
+#define NTP_BURST_ROUNDS NTP_FILTER_STAGES   // Rounds in the initial sync: a full filter, like ntpd's iburst
+#define NTP_QUERY_INTERVAL 200000 // Microseconds between burst rounds (200ms)
 #define NTP_ERROR_THRESHOLD (10 * MICROSECONDS_PER_SECOND) // 10 seconds in microseconds
+#define NTP_REPLY_TIMEOUT_US MICROSECONDS_PER_SECOND          // Servers still silent after this miss the round
 
 // NTP packet structure according to RFC 5905
 typedef struct {
@@ -32,25 +40,119 @@ typedef struct {
     uint32_t tx_ts_frac;     // Transmit timestamp fraction
 } ntp_packet;
 
-// Structure for NTP thread arguments 
+// Non-blocking NTP client states
+#define NTP_CLIENT_IDLE       0   // Waiting for the next sync
+#define NTP_CLIENT_WAIT_REPLY 1   // Round sent, timer is the reply timeout
+#define NTP_CLIENT_WAIT_NEXT  2   // Spacing before the next round of a burst
+
+// One configured server: its own connected socket, so each has a single
+// query in flight and its own transmit timestamps, and its own clock filter.
+// The socket lives as long as the client, reconnected if the name comes to
+// resolve elsewhere.
+typedef struct {
+    const char *name;
+    struct sockaddr_storage addr;  // IPv4 or IPv6
+    socklen_t addr_len;            // 0 while the name has not resolved
+    uint32_t addr_generation;      // Resolver generation of addr
+    int sock;                      // Non-blocking UDP socket, -1 until resolved
+    int waiting;                   // Query of this round not yet answered
+    uint32_t tx_ts_sec;            // Transmit stamp of the query in flight,
+    uint32_t tx_ts_frac;           // echoed back as the reply's origin
+    struct timespec tx_time;       // Local send time of that query (T1)
+    int tx_source;                 // NTP_TS_* for tx_time
+    uint8_t reach;                 // Rounds answered, newest in bit 0
+    int silent_rounds;             // Queries sent since the last reply
+    int64_t root_delay_us;         // From the last reply
+    int64_t root_dispersion_us;
+    ntp_filter_t filter;
+    int status;                    // NTP_CAND_* in the last selection, -1 if not a candidate
+} ntp_peer_t;
+
+// State of a sync for the status file, and the state file when due,
+// copied for the resolver thread to write so the sync path never waits on
+// the filesystem
+typedef struct {
+    int64_t mono_us;               // CLOCK_MONOTONIC when taken
+    int64_t time_s;                // CLOCK_REALTIME then
+    clock_discipline_t discipline;
+    ntp_selection_t selection;
+    const char *system_peer;
+    int servers;
+    int64_t sync_latency_us;
+    int save_state;
+    saved_state_t state;
+} ntp_report_t;
+
+// Queries every configured server at once. A sync is one round, one query
+// per server, so it takes one round trip; the initial sync is a burst of
+// NTP_BURST_ROUNDS rounds to fill the clock filters. One timerfd drives the
+// reply timeout, the burst spacing and the sync interval, and the peers'
+// sockets sit in an epoll set of their own, so the caller polls just timer
+// and fd.
 typedef struct {
-    const char *server;
     int display_enabled;
-} ntp_thread_args_t;
+    int blocking;                  // Inside ntp_client_sync: the caller reports
+    int timer;                     // timerfd
+    int fd;                        // epoll set of the peer sockets
+    int state;
+    int rounds;                    // Rounds left in this sync, including the current one
+    int round;                     // Rounds of this sync already sent
+    int waiting;                   // Peers yet to answer this round
+    int status;                    // Result of the last sync
+    char names[256];               // Server list, split in place
+    int num_peers;
+    ntp_peer_t peers[NTP_MAX_SERVERS];
+    ntp_selection_t selection;     // Of the last successful sync
+    clock_discipline_t discipline; // Turns each sync's offset into the published correction
+    ntp_resolver_t resolver;       // Server addresses, refreshed off the sync path
+    ntp_report_t report;           // Last posted to the resolver thread, under its lock
+    int state_due;                 // A state save not yet posted
+    // Time from a sync's first query to its result
+    int64_t sync_start_us;
+    int64_t sync_latency_us;       // Of the last sync
+    int64_t sync_total_us;
+    int64_t sync_max_us;
+    unsigned long syncs;
+} ntp_client_t;
 
 // Global variables related to NTP
 extern char ntp_server[256];
-extern int64_t ntp_adjustment_step_us;
 extern int ntp_sync_interval;
 extern int ntp_slew_period;
-extern int64_t ntp_offset_us;
-extern int64_t ntp_target_offset_us;
+extern char ntp_status_file[256];      // Discipline state for monitoring, empty for none
+extern int64_t ntp_target_offset_us;   // Last accepted offset, owned by the sync thread
 
 // Function declarations
 int64_t ntp_to_unix_us(uint32_t ntp_sec, uint32_t ntp_frac);
 void get_system_time_ntp(uint32_t *sec, uint32_t *frac);
-int64_t perform_single_ntp_query(const char *hostname, int sockfd, struct sockaddr_in *server_addr);
-int query_ntp_server(const char *hostname);
+void ntp_report_sync(const ntp_client_t *c);
+void ntp_report_stats(ntp_client_t *c);
+const char *ntp_ts_source_name(int source);
+void ntp_publish_correction(const clock_correction_t *correction);
+int ntp_try_read_correction(clock_correction_t *correction);
+// Correction now, for real-time threads: *snapshot, kept by the caller
+// across calls, is refreshed if a consistent read succeeds, so this never
+// waits on the sync thread
+int64_t ntp_correction_now(clock_correction_t *snapshot);
+// Correction now, retrying the read (non real-time threads)
+int64_t ntp_applied_offset(void);
+int64_t monotonic_now_us(void);
 void* ntp_sync_thread(void *arg);
+// Resolves every server once, then leaves refreshing the addresses to a
+// resolver thread kept off cpu_core
+int ntp_client_open(ntp_client_t *c, const char *servers, int display_enabled, int cpu_core);
+// Publish a correction restored from a previous run before any sync
+void ntp_client_restore(ntp_client_t *c, int32_t freq_ppb, int64_t offset_us);
+// Initial sync: a burst of NTP_BURST_ROUNDS rounds to fill every server's
+// clock filter. ntp_client_start sends the first round and leaves the rest
+// to the thread or event loop; ntp_client_sync runs it to completion and
+// applies the result as a step, so it is for use before output starts.
+// Both arm the periodic syncs. ntp_client_sync returns 0 if an offset was
+// applied.
+void ntp_client_start(ntp_client_t *c);
+int ntp_client_sync(ntp_client_t *c);
+void ntp_client_on_timer(ntp_client_t *c);
+void ntp_client_on_reply(ntp_client_t *c);
+void ntp_client_close(ntp_client_t *c);
 
 #endif // LTC_NTP_H
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "ltc_ntp_filter.h"
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * MICROSECONDS_PER_SECOND + ts.tv_nsec / NANOSECONDS_PER_MICROSECOND;
+}
+
+// Dispersion accumulated at PHI over an interval
+static int64_t phi_us(int64_t interval_us) {
+    return interval_us * NTP_PHI_PPM / MICROSECONDS_PER_SECOND;
+}
+
+void ntp_sample_init(ntp_sample_t *s, int64_t t1, int64_t t2, int64_t t3, int64_t t4,
+                     int8_t server_precision) {
+    int64_t precision_us = (int64_t)ldexp((double)MICROSECONDS_PER_SECOND, server_precision) +
+                           NTP_CLIENT_PRECISION_US;
+
+    s->offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+    s->delay_us = (t4 - t1) - (t3 - t2);
+    // Clock steps or a busy server can make the measured delay negative
+    if (s->delay_us < precision_us) {
+        s->delay_us = precision_us;
+    }
+    s->dispersion_us = precision_us + phi_us(t4 - t1);
+    s->time_us = monotonic_us();
+    s->tx_source = NTP_TS_USER;
+    s->rx_source = NTP_TS_USER;
+}
+
+void ntp_filter_add(ntp_filter_t *f, const ntp_sample_t *s) {
+    memmove(&f->stage[1], &f->stage[0], sizeof(f->stage[0]) * (NTP_FILTER_STAGES - 1));
+    f->stage[0] = *s;
+    if (f->count < NTP_FILTER_STAGES) {
+        f->count++;
+    }
+    f->samples++;
+}
+
+int ntp_filter_select(ntp_filter_t *f) {
+    if (f->count == 0) {
+        return -1;
+    }
+
+    // Each stage's dispersion grows at PHI since it was taken
+    int64_t now = monotonic_us();
+    int64_t disp[NTP_FILTER_STAGES];
+    int64_t distance[NTP_FILTER_STAGES];
+    for (int i = 0; i < f->count; i++) {
+        const ntp_sample_t *s = &f->stage[i];
+        disp[i] = s->dispersion_us + phi_us(now - s->time_us);
+        if (disp[i] > NTP_MAX_DISPERSION_US) disp[i] = NTP_MAX_DISPERSION_US;
+        distance[i] = s->delay_us / 2 + disp[i];
+    }
+
+    // Stages by increasing distance; equal distances keep the newer sample first
+    int order[NTP_FILTER_STAGES];
+    for (int i = 0; i < f->count; i++) {
+        int j = i;
+        while (j > 0 && distance[order[j - 1]] > distance[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    const ntp_sample_t *best = &f->stage[order[0]];
+
+    // Empty stages count as the maximum. Weights halve down the sorted list.
+    double dispersion = 0.0;
+    double jitter = 0.0;
+    for (int i = 0; i < NTP_FILTER_STAGES; i++) {
+        int64_t d = NTP_MAX_DISPERSION_US;
+        if (i < f->count) {
+            const ntp_sample_t *s = &f->stage[order[i]];
+            d = disp[order[i]];
+            double diff = (double)(s->offset_us - best->offset_us);
+            jitter += diff * diff;
+        }
+        dispersion += ldexp((double)d, -(i + 1));
+    }
+
+    f->offset_us = best->offset_us;
+    f->delay_us = best->delay_us;
+    f->time_us = best->time_us;
+    f->dispersion_us = (int64_t)dispersion;
+    f->tx_source = best->tx_source;
+    f->rx_source = best->rx_source;
+    f->jitter_us = f->count > 1 ? (int64_t)sqrt(jitter / (f->count - 1)) : 0;
+    if (f->jitter_us < NTP_CLIENT_PRECISION_US) {
+        f->jitter_us = NTP_CLIENT_PRECISION_US;
+    }
+    return 0;
+}
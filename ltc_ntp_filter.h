@@ -0,0 +1,59 @@
+#ifndef LTC_NTP_FILTER_H
+#define LTC_NTP_FILTER_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+
+#define NTP_FILTER_STAGES 8                          // RFC 5905 clock filter length
+#define NTP_PHI_PPM 15                               // Frequency tolerance: dispersion growth
+#define NTP_MAX_DISPERSION_US (16 * MICROSECONDS_PER_SECOND)
+#define NTP_CLIENT_PRECISION_US 1                    // Our timestamps are kept in microseconds
+
+// Where a sample's local timestamps (T1, T4) came from
+#define NTP_TS_USER    0   // clock_gettime next to the send or receive call
+#define NTP_TS_KERNEL  1   // Kernel socket timestamp
+
+// One query's result from the four on-wire timestamps: T1 client transmit,
+// T2 server receive, T3 server transmit, T4 client receive (Unix us)
+typedef struct {
+    int64_t offset_us;         // theta = ((T2 - T1) + (T3 - T4)) / 2
+    int64_t delay_us;          // delta = (T4 - T1) - (T3 - T2)
+    int64_t dispersion_us;     // epsilon when taken: both precisions plus PHI over the round trip
+    int64_t time_us;           // CLOCK_MONOTONIC when taken, to age the dispersion
+    uint8_t tx_source;         // NTP_TS_* for T1
+    uint8_t rx_source;         // NTP_TS_* for T4
+} ntp_sample_t;
+
+// RFC 5905 clock filter: the last NTP_FILTER_STAGES samples, from which the
+// one with the smallest synchronization distance (half the round-trip delay
+// plus the dispersion, which grows with age) is taken. Among samples taken
+// close together that is the shortest round trip, whose offset carries the
+// least path asymmetry; a stale sample gives way to a fresh one within a
+// minute or so. The dispersion and jitter describe how much the result can
+// be trusted.
+typedef struct {
+    ntp_sample_t stage[NTP_FILTER_STAGES];   // Newest first
+    int count;
+    unsigned long samples;                   // Accepted since start
+    // Result of the last ntp_filter_select
+    int64_t offset_us;
+    int64_t delay_us;
+    int64_t time_us;           // When the selected sample was taken
+    int64_t dispersion_us;     // Weighted dispersion of the sorted stages
+    int64_t jitter_us;         // RMS offset difference from the selected sample
+    int tx_source;             // Timestamp sources of the selected sample
+    int rx_source;
+} ntp_filter_t;
+
+// Fill a sample from the on-wire timestamps. server_precision is the
+// packet's log2 seconds field. The timestamp sources default to NTP_TS_USER.
+void ntp_sample_init(ntp_sample_t *s, int64_t t1, int64_t t2, int64_t t3, int64_t t4,
+                     int8_t server_precision);
+
+void ntp_filter_add(ntp_filter_t *f, const ntp_sample_t *s);
+
+// Select the minimum distance sample and update the statistics. Returns -1
+// while the filter is empty.
+int ntp_filter_select(ntp_filter_t *f);
+
+#endif // LTC_NTP_FILTER_H
@@ -0,0 +1,245 @@
+#include "ltc_ntp_resolve.h"
+#include "ltc_ntp.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+void ntp_resolver_init(ntp_resolver_t *r) {
+    memset(r, 0, sizeof(*r));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&r->wake, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+int ntp_resolver_add(ntp_resolver_t *r, const char *name) {
+    if (r->count == NTP_RESOLVE_MAX_NAMES) {
+        return -1;
+    }
+    ntp_resolve_entry_t *e = &r->entry[r->count];
+    memset(e, 0, sizeof(*e));
+    e->name = name;
+    return r->count++;
+}
+
+void ntp_address_text(const struct sockaddr_storage *addr, char *buf, size_t n) {
+    const void *ip = addr->ss_family == AF_INET6 ?
+                     (const void *)&((const struct sockaddr_in6 *)addr)->sin6_addr :
+                     (const void *)&((const struct sockaddr_in *)addr)->sin_addr;
+    if (inet_ntop(addr->ss_family, ip, buf, (socklen_t)n) == NULL) {
+        snprintf(buf, n, "?");
+    }
+}
+
+// Look the name up, without the lock. getaddrinfo orders the results by
+// RFC 6724, so an IPv6 address comes first where IPv6 is routable. Returns
+// 0 with up to NTP_RESOLVE_MAX_ADDRS addresses in that order.
+static int resolve_name(const char *name, struct sockaddr_storage *addrs, socklen_t *addr_lens,
+                        int *count, int64_t *latency_us) {
+    struct addrinfo hints, *res = NULL;
+    char port[8];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    snprintf(port, sizeof(port), "%d", NTP_PORT);
+
+    int64_t start = monotonic_now_us();
+    int err = getaddrinfo(name, port, &hints, &res);
+    *latency_us = monotonic_now_us() - start;
+    if (err != 0) {
+        fprintf(stderr, "Cannot resolve NTP server %s: %s\n", name,
+                err == EAI_SYSTEM ? strerror(errno) : gai_strerror(err));
+        return -1;
+    }
+
+    *count = 0;
+    for (const struct addrinfo *ai = res; ai != NULL && *count < NTP_RESOLVE_MAX_ADDRS; ai = ai->ai_next) {
+        // The same address can come back more than once, e.g. from /etc/hosts
+        int seen = 0;
+        for (int j = 0; j < *count && !seen; j++) {
+            seen = addr_lens[j] == ai->ai_addrlen && memcmp(&addrs[j], ai->ai_addr, ai->ai_addrlen) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+        memset(&addrs[*count], 0, sizeof(addrs[*count]));
+        memcpy(&addrs[*count], ai->ai_addr, ai->ai_addrlen);
+        addr_lens[*count] = (socklen_t)ai->ai_addrlen;
+        (*count)++;
+    }
+    freeaddrinfo(res);
+    return *count > 0 ? 0 : -1;
+}
+
+static void resolver_use(ntp_resolve_entry_t *e, int k) {
+    e->current = k;
+    e->addr = e->addrs[k];
+    e->addr_len = e->addr_lens[k];
+    e->generation++;
+}
+
+// Look up entry i and store the result. Called with the lock held; drops it
+// around getaddrinfo.
+static int resolver_refresh(ntp_resolver_t *r, int i) {
+    ntp_resolve_entry_t *e = &r->entry[i];
+    struct sockaddr_storage addrs[NTP_RESOLVE_MAX_ADDRS];
+    socklen_t addr_lens[NTP_RESOLVE_MAX_ADDRS];
+    int count = 0;
+    int64_t latency = 0;
+
+    pthread_mutex_unlock(&r->lock);
+    int status = resolve_name(e->name, addrs, addr_lens, &count, &latency);
+    pthread_mutex_lock(&r->lock);
+
+    e->latency_us = latency;
+    r->lookups++;
+    r->total_us += latency;
+    if (latency > r->max_us) r->max_us = latency;
+    if (status < 0) {
+        // Keep serving the cached address, if any, and ask again soon
+        r->failures++;
+        int64_t retry_s = (int64_t)NTP_RESOLVE_RETRY_S << (e->failures < 8 ? e->failures : 8);
+        if (retry_s > NTP_RESOLVE_REFRESH_S) retry_s = NTP_RESOLVE_REFRESH_S;
+        e->failures++;
+        e->next_us = monotonic_now_us() + retry_s * MICROSECONDS_PER_SECOND;
+        return e->addr_len > 0 ? 0 : -1;
+    }
+    e->failures = 0;
+
+    // Stay on the address in use while the name still lists it
+    int k = 0;
+    for (int j = 0; j < count; j++) {
+        if (addr_lens[j] == e->addr_len && memcmp(&addrs[j], &e->addr, addr_lens[j]) == 0) {
+            k = j;
+            break;
+        }
+    }
+    memcpy(e->addrs, addrs, sizeof(addrs[0]) * (size_t)count);
+    memcpy(e->addr_lens, addr_lens, sizeof(addr_lens[0]) * (size_t)count);
+    e->num_addrs = count;
+    e->current = k;
+    if (addr_lens[k] != e->addr_len || memcmp(&addrs[k], &e->addr, addr_lens[k]) != 0) {
+        if (e->addr_len > 0) r->changes++;
+        resolver_use(e, k);
+    }
+    e->next_us = monotonic_now_us() + (int64_t)NTP_RESOLVE_REFRESH_S * MICROSECONDS_PER_SECOND;
+    return 0;
+}
+
+int ntp_resolver_lookup(ntp_resolver_t *r, int i) {
+    pthread_mutex_lock(&r->lock);
+    int status = resolver_refresh(r, i);
+    pthread_mutex_unlock(&r->lock);
+    return status;
+}
+
+static void* resolver_thread(void *arg) {
+    ntp_resolver_t *r = (ntp_resolver_t*)arg;
+
+    drop_realtime(r->cpu_core);
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop) {
+        if (r->job_pending) {
+            r->job_pending = 0;
+            r->job(r, r->job_ctx);
+            continue;
+        }
+        int64_t now = monotonic_now_us();
+        int due = -1;
+        int64_t next = INT64_MAX;
+        for (int i = 0; i < r->count; i++) {
+            if (r->entry[i].next_us < next) {
+                next = r->entry[i].next_us;
+                due = i;
+            }
+        }
+        if (due >= 0 && next <= now) {
+            resolver_refresh(r, due);
+            continue;
+        }
+        struct timespec until;
+        until.tv_sec = next / MICROSECONDS_PER_SECOND;
+        until.tv_nsec = (next % MICROSECONDS_PER_SECOND) * NANOSECONDS_PER_MICROSECOND;
+        pthread_cond_timedwait(&r->wake, &r->lock, &until);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+int ntp_resolver_start(ntp_resolver_t *r, int cpu_core) {
+    r->cpu_core = cpu_core;
+    if (pthread_create(&r->thread, NULL, resolver_thread, r) != 0) {
+        fprintf(stderr, "Failed to start NTP resolver thread, server addresses will not be refreshed\n");
+        return -1;
+    }
+    r->started = 1;
+    return 0;
+}
+
+int ntp_resolver_next(ntp_resolver_t *r, int i) {
+    if (pthread_mutex_trylock(&r->lock) != 0) {
+        return 0;
+    }
+    ntp_resolve_entry_t *e = &r->entry[i];
+    int moved = e->num_addrs > 1;
+    if (moved) {
+        resolver_use(e, (e->current + 1) % e->num_addrs);
+        r->failovers++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return moved;
+}
+
+void ntp_resolver_set_job(ntp_resolver_t *r, ntp_resolver_job_fn job, void *ctx) {
+    r->job = job;
+    r->job_ctx = ctx;
+}
+
+int ntp_resolver_post_begin(ntp_resolver_t *r) {
+    if (!r->started || r->job == NULL || pthread_mutex_trylock(&r->lock) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void ntp_resolver_post_end(ntp_resolver_t *r) {
+    r->job_pending = 1;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+}
+
+int ntp_resolver_get(ntp_resolver_t *r, int i, struct sockaddr_storage *addr,
+                     socklen_t *addr_len, uint32_t *generation) {
+    if (pthread_mutex_trylock(&r->lock) != 0) {
+        return 0;
+    }
+    const ntp_resolve_entry_t *e = &r->entry[i];
+    int changed = e->generation != *generation;
+    if (changed) {
+        *addr = e->addr;
+        *addr_len = e->addr_len;
+        *generation = e->generation;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return changed;
+}
+
+void ntp_resolver_stop(ntp_resolver_t *r) {
+    if (r->started) {
+        pthread_mutex_lock(&r->lock);
+        r->stop = 1;
+        pthread_cond_signal(&r->wake);
+        pthread_mutex_unlock(&r->lock);
+        pthread_join(r->thread, NULL);
+        r->started = 0;
+    }
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+}
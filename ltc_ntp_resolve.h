@@ -0,0 +1,91 @@
+#ifndef LTC_NTP_RESOLVE_H
+#define LTC_NTP_RESOLVE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "ltc_common.h"
+
+#define NTP_RESOLVE_MAX_NAMES 8
+#define NTP_RESOLVE_MAX_ADDRS 8      // Addresses kept per name, to fail over between
+#define NTP_RESOLVE_REFRESH_S 3600   // Cached addresses are looked up again after this
+#define NTP_RESOLVE_RETRY_S 30       // Failed names are retried after this, doubling up to the refresh
+
+// One server name, the addresses it last resolved to and the one in use
+typedef struct {
+    const char *name;
+    struct sockaddr_storage addr;    // In use: addrs[current]
+    socklen_t addr_len;              // 0 until the name first resolves
+    struct sockaddr_storage addrs[NTP_RESOLVE_MAX_ADDRS];
+    socklen_t addr_lens[NTP_RESOLVE_MAX_ADDRS];
+    int num_addrs;
+    int current;
+    uint32_t generation;             // Bumped whenever the address changes
+    int64_t next_us;                 // CLOCK_MONOTONIC time of the next lookup
+    int64_t latency_us;              // Of the last lookup
+    int failures;                    // Consecutive failed lookups
+} ntp_resolve_entry_t;
+
+// Address cache for the NTP servers, refreshed by a thread of its own so a
+// slow or dead DNS server never holds up a sync. getaddrinfo does not report
+// record TTLs, so every entry is simply looked up again after
+// NTP_RESOLVE_REFRESH_S, through the system resolver, which honours them.
+// A refresh that still returns the address in use keeps it, so a
+// round-robin name does not swap servers and lose their clock filters. The
+// client moves a silent server on to the name's next address.
+// The thread also runs a job posted by the sync path, for work such as file
+// writes that must not stall the real-time thread the client may run on.
+typedef struct ntp_resolver ntp_resolver_t;
+typedef void (*ntp_resolver_job_fn)(ntp_resolver_t *r, void *ctx);
+
+struct ntp_resolver {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int started;
+    int stop;
+    int cpu_core;                    // Kept off the audio core
+    int count;
+    ntp_resolve_entry_t entry[NTP_RESOLVE_MAX_NAMES];
+    ntp_resolver_job_fn job;         // Called with the lock held; may drop it
+    void *job_ctx;
+    int job_pending;
+    // Statistics, under lock
+    unsigned long lookups;
+    unsigned long failures;
+    unsigned long changes;
+    unsigned long failovers;
+    int64_t total_us;
+    int64_t max_us;
+};
+
+void ntp_resolver_init(ntp_resolver_t *r);
+// Add a name before ntp_resolver_start. Returns its index, or -1 when full.
+int ntp_resolver_add(ntp_resolver_t *r, const char *name);
+// Resolve entry i now, on the calling thread. Returns 0 if it has an address.
+int ntp_resolver_lookup(ntp_resolver_t *r, int i);
+int ntp_resolver_start(ntp_resolver_t *r, int cpu_core);
+// Copy entry i's address if its generation differs from *generation. Never
+// waits: returns 1 with the address copied, 0 if unchanged or the resolver
+// thread holds the lock, in which case the caller keeps its address.
+int ntp_resolver_get(ntp_resolver_t *r, int i, struct sockaddr_storage *addr,
+                     socklen_t *addr_len, uint32_t *generation);
+// Move entry i on to its next address, for a server silent at the one in
+// use; ntp_resolver_get then returns it. Never waits: returns 1 if moved,
+// 0 if the name has no other address or the resolver thread holds the lock.
+int ntp_resolver_next(ntp_resolver_t *r, int i);
+// Set the job, before ntp_resolver_start
+void ntp_resolver_set_job(ntp_resolver_t *r, ntp_resolver_job_fn job, void *ctx);
+// Post the job from another thread. Never waits: returns 0 with the lock
+// held, for the caller to hand over the job's data before
+// ntp_resolver_post_end, or -1 if the resolver thread holds the lock or is
+// not running.
+int ntp_resolver_post_begin(ntp_resolver_t *r);
+void ntp_resolver_post_end(ntp_resolver_t *r);
+// Stop the thread, waiting for a lookup in progress to finish
+void ntp_resolver_stop(ntp_resolver_t *r);
+
+// Numeric form of an address, for logging
+void ntp_address_text(const struct sockaddr_storage *addr, char *buf, size_t n);
+
+#endif // LTC_NTP_RESOLVE_H
@@ -0,0 +1,162 @@
+#include "ltc_ntp_select.h"
+#include <stdlib.h>
+#include <math.h>
+
+// Correctness interval endpoint: -1 low edge, 0 midpoint, +1 high edge
+typedef struct {
+    int64_t value;
+    int type;
+} ntp_endpoint_t;
+
+static int compare_endpoints(const void *a, const void *b) {
+    const ntp_endpoint_t *x = (const ntp_endpoint_t*)a;
+    const ntp_endpoint_t *y = (const ntp_endpoint_t*)b;
+    if (x->value != y->value) return x->value < y->value ? -1 : 1;
+    return x->type - y->type;   // Widest interval on ties
+}
+
+static int compare_distance(const void *a, const void *b) {
+    const ntp_candidate_t *x = *(const ntp_candidate_t * const *)a;
+    const ntp_candidate_t *y = *(const ntp_candidate_t * const *)b;
+    if (x->distance_us != y->distance_us) return x->distance_us < y->distance_us ? -1 : 1;
+    return 0;
+}
+
+int64_t ntp_root_distance(int64_t root_delay_us, int64_t root_dispersion_us, int64_t delay_us,
+                          int64_t dispersion_us, int64_t jitter_us) {
+    int64_t delay = root_delay_us + delay_us;
+    if (delay < NTP_MIN_DISPERSION_US) {
+        delay = NTP_MIN_DISPERSION_US;
+    }
+    return delay / 2 + root_dispersion_us + dispersion_us + jitter_us;
+}
+
+// Smallest interval containing the midpoints of a majority, allowing for
+// up to n/2 falsetickers (Marzullo's algorithm as modified for NTP)
+static int ntp_intersect(const ntp_candidate_t *cand, int n, int64_t *low, int64_t *high) {
+    ntp_endpoint_t *ep = malloc(sizeof(*ep) * 3 * n);
+    if (ep == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        ep[3 * i].value = cand[i].offset_us - cand[i].distance_us;
+        ep[3 * i].type = -1;
+        ep[3 * i + 1].value = cand[i].offset_us;
+        ep[3 * i + 1].type = 0;
+        ep[3 * i + 2].value = cand[i].offset_us + cand[i].distance_us;
+        ep[3 * i + 2].type = 1;
+    }
+    qsort(ep, 3 * n, sizeof(*ep), compare_endpoints);
+
+    int found_interval = -1;
+    for (int allow = 0; 2 * allow < n; allow++) {
+        int found = 0;
+        int chime = 0;
+        for (int j = 0; j < 3 * n; j++) {
+            chime -= ep[j].type;
+            if (chime >= n - allow) {
+                *low = ep[j].value;
+                break;
+            }
+            if (ep[j].type == 0) found++;
+        }
+        chime = 0;
+        for (int j = 3 * n - 1; j >= 0; j--) {
+            chime += ep[j].type;
+            if (chime >= n - allow) {
+                *high = ep[j].value;
+                break;
+            }
+            if (ep[j].type == 0) found++;
+        }
+        // More midpoints outside than falsetickers allowed: allow one more
+        if (found > allow) {
+            continue;
+        }
+        if (*high > *low) {
+            found_interval = 0;
+            break;
+        }
+    }
+    free(ep);
+    return found_interval;
+}
+
+// Selection jitter of s[i]: RMS offset difference from the other survivors
+static double selection_jitter(ntp_candidate_t * const *s, int n, int i) {
+    double sum = 0.0;
+    for (int j = 0; j < n; j++) {
+        double diff = (double)(s[j]->offset_us - s[i]->offset_us);
+        sum += diff * diff;
+    }
+    return n > 1 ? sqrt(sum / (n - 1)) : 0.0;
+}
+
+int ntp_select(ntp_candidate_t *cand, int n, ntp_selection_t *result) {
+    int64_t low = 0, high = 0;
+    for (int i = 0; i < n; i++) {
+        cand[i].status = NTP_CAND_FALSETICKER;
+    }
+    if (n <= 0 || ntp_intersect(cand, n, &low, &high) < 0) {
+        return -1;
+    }
+
+    // Truechimers: midpoints inside the intersection, best distance first
+    ntp_candidate_t **s = malloc(sizeof(*s) * n);
+    if (s == NULL) {
+        return -1;
+    }
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (cand[i].offset_us >= low && cand[i].offset_us <= high) {
+            cand[i].status = NTP_CAND_OUTLIER;
+            s[m++] = &cand[i];
+        }
+    }
+    qsort(s, m, sizeof(*s), compare_distance);
+    result->truechimers = m;
+
+    // Cluster: drop the survivor that adds the most selection jitter until
+    // that is below every survivor's own jitter or only NMIN are left
+    while (m > NTP_MIN_CLUSTER) {
+        int worst = 0;
+        double max_jitter = -1.0;
+        int64_t min_peer_jitter = INT64_MAX;
+        for (int i = 0; i < m; i++) {
+            double jitter = selection_jitter(s, m, i);
+            if (jitter > max_jitter) {
+                max_jitter = jitter;
+                worst = i;
+            }
+            if (s[i]->jitter_us < min_peer_jitter) {
+                min_peer_jitter = s[i]->jitter_us;
+            }
+        }
+        if (max_jitter <= (double)min_peer_jitter) {
+            break;
+        }
+        for (int i = worst; i < m - 1; i++) {
+            s[i] = s[i + 1];
+        }
+        m--;
+    }
+
+    // Combine, weighting each survivor by 1/root distance
+    double x = 0.0, y = 0.0, z = 0.0;
+    for (int i = 0; i < m; i++) {
+        double distance = s[i]->distance_us > 0 ? (double)s[i]->distance_us : 1.0;
+        double diff = (double)(s[i]->offset_us - s[0]->offset_us);
+        s[i]->status = NTP_CAND_SURVIVOR;
+        x += 1.0 / distance;
+        y += s[i]->offset_us / distance;
+        z += diff * diff / distance;
+    }
+    double peer_jitter = (double)s[0]->jitter_us;
+    result->offset_us = (int64_t)llround(y / x);
+    result->jitter_us = (int64_t)sqrt(z / x + peer_jitter * peer_jitter);
+    result->distance_us = s[0]->distance_us;
+    result->system_peer = s[0]->peer;
+    result->survivors = m;
+    free(s);
+    return 0;
+}
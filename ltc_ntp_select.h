@@ -0,0 +1,43 @@
+#ifndef LTC_NTP_SELECT_H
+#define LTC_NTP_SELECT_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+
+#define NTP_MAX_DISTANCE_US (1500 * 1000)   // MAXDIST: larger root distances are not selectable
+#define NTP_MIN_DISPERSION_US (10 * 1000)   // MINDISP: floor on the delay in the root distance
+#define NTP_MIN_CLUSTER 3                   // NMIN: clustering never prunes below this
+
+// Candidate status after ntp_select
+#define NTP_CAND_FALSETICKER 0   // Offset outside the majority's intersection
+#define NTP_CAND_OUTLIER     1   // Truechimer pruned by clustering
+#define NTP_CAND_SURVIVOR    2   // Combined into the system offset
+
+// One server's clock filter result, as input to source selection
+typedef struct {
+    int64_t offset_us;
+    int64_t distance_us;   // Root distance: half-width of its correctness interval
+    int64_t jitter_us;     // Peer jitter from its clock filter
+    int peer;              // Caller's index
+    int status;            // NTP_CAND_*, set by ntp_select
+} ntp_candidate_t;
+
+typedef struct {
+    int64_t offset_us;     // Survivors' offsets weighted by 1/root distance
+    int64_t jitter_us;     // System jitter: selection and system peer jitter combined
+    int64_t distance_us;   // Error bound: the system peer's root distance
+    int system_peer;       // Caller's index of the survivor with the smallest distance
+    int truechimers;
+    int survivors;
+} ntp_selection_t;
+
+// Root distance of a server from its last reply and clock filter
+int64_t ntp_root_distance(int64_t root_delay_us, int64_t root_dispersion_us, int64_t delay_us,
+                          int64_t dispersion_us, int64_t jitter_us);
+
+// RFC 5905 selection (intersection of correctness intervals), clustering and
+// combining over n candidates. Sets each candidate's status. Returns -1 when
+// no majority of the candidates agree.
+int ntp_select(ntp_candidate_t *cand, int n, ntp_selection_t *result);
+
+#endif // LTC_NTP_SELECT_H
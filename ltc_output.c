@@ -0,0 +1,527 @@
+#include "ltc_output.h"
+#include "ltc_latency.h"
+#include "ltc_render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/timerfd.h>
+
+//---------- ALSA ----------//
+
+// The hardware behind a plugin PCM (plug, dmix, ...), opened only to ask
+// what it takes. The plugin PCM holds the card itself, so it is closed
+// meanwhile. NULL when the PCM is the hardware itself, has no card behind
+// it (a sound server) or the card is held by another stream.
+static snd_pcm_t *alsa_open_hardware(output_t *out) {
+    snd_pcm_info_t *info;
+    snd_pcm_info_alloca(&info);
+    snd_pcm_t *hw = NULL;
+
+    if (snd_pcm_type(out->pcm) == SND_PCM_TYPE_HW) {
+        snprintf(out->hardware, sizeof(out->hardware), "%s", snd_pcm_name(out->pcm));
+        return NULL;
+    }
+    if (snd_pcm_info(out->pcm, info) < 0 || snd_pcm_info_get_card(info) < 0) {
+        return NULL;
+    }
+    char name[sizeof(out->hardware)];
+    snprintf(name, sizeof(name), "hw:%d,%u", snd_pcm_info_get_card(info), snd_pcm_info_get_device(info));
+    snd_pcm_close(out->pcm);
+    out->pcm = NULL;
+    if (snd_pcm_open(&hw, name, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK) < 0) {
+        return NULL;
+    }
+    snprintf(out->hardware, sizeof(out->hardware), "%s", name);
+    return hw;
+}
+
+// Open the PCM again after alsa_open_hardware let go of it
+static int alsa_reopen(output_t *out) {
+    if (out->pcm) {
+        return 0;
+    }
+    int err = snd_pcm_open(&out->pcm, out->target, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        fprintf(stderr, "Failed to reopen PCM device '%s'\n", out->target);
+    }
+    return err;
+}
+
+// Ask the hardware, or failing that the PCM itself, for the first sample
+// format in SAMPLE_FORMAT_* order and the first candidate rate it takes
+// without resampling
+static int alsa_negotiate(output_t *out, int format, unsigned int rate) {
+    static const unsigned int candidates[] = SAMPLE_RATE_CANDIDATES;
+    snd_pcm_hw_params_t *params;
+    snd_pcm_hw_params_alloca(&params);
+
+    snd_pcm_t *hw = alsa_open_hardware(out);
+    if (!hw && alsa_reopen(out) < 0) {
+        return -1;
+    }
+    snd_pcm_t *probe = hw ? hw : out->pcm;
+    int known = snd_pcm_hw_params_any(probe, params) >= 0;
+    if (known) {
+        snd_pcm_hw_params_set_rate_resample(probe, params, 0);
+    }
+
+    if (format == SAMPLE_FORMAT_AUTO) {
+        format = SAMPLE_FORMAT_S16;
+        for (int i = 0; known && i < NUM_SAMPLE_FORMATS; i++) {
+            if (snd_pcm_hw_params_test_format(probe, params, sample_formats[i].alsa) == 0) {
+                format = i;
+                break;
+            }
+        }
+    }
+    if (known && snd_pcm_hw_params_test_format(probe, params, sample_formats[format].alsa) == 0) {
+        snd_pcm_hw_params_set_format(probe, params, sample_formats[format].alsa);
+    }
+
+    if (rate == 0) {
+        rate = DEFAULT_SAMPLE_RATE;
+        for (size_t i = 0; known && i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+            if (snd_pcm_hw_params_test_rate(probe, params, candidates[i], 0) == 0) {
+                rate = candidates[i];
+                break;
+            }
+        }
+    }
+
+    if (hw) {
+        snd_pcm_close(hw);
+        if (alsa_reopen(out) < 0) {
+            return -1;
+        }
+    }
+    out->format = sample_format_get(format);
+    out->rate = rate;
+    return 0;
+}
+
+// Each conversion a plugin still applies shows up in the PCM's setup dump as
+// a line like "Rate conversion PCM (96000, sformat=S32_LE)". Lists them in
+// buf and returns how many there are.
+static int alsa_describe_conversion(snd_pcm_t *pcm, char *buf, size_t n) {
+    snd_output_t *log;
+    char *text;
+    int stages = 0;
+    size_t used = 0;
+
+    buf[0] = 0;
+    if (snd_output_buffer_open(&log) < 0) {
+        return 0;
+    }
+    snd_pcm_dump(pcm, log);
+    snd_output_buffer_string(log, &text);
+
+    char *save = NULL;
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        const char *stage = strstr(line, "conversion PCM");
+        if (stage) {
+            // Drop the "Plug PCM: " prefix the first stage is dumped with
+            const char *colon = strstr(line, ": ");
+            stage = colon && colon < stage ? colon + 2 : line;
+        } else if (strstr(line, "Direct Stream Mixing PCM")) {
+            stage = "dmix software mixing";
+        } else {
+            continue;
+        }
+        if (used < n) {
+            used += (size_t)snprintf(buf + used, n - used, "%s%s", stages ? "; " : "", stage);
+        }
+        stages++;
+    }
+    snd_output_close(log);
+    return stages;
+}
+
+static int alsa_configure(output_t *out, unsigned int rate, int frame_size) {
+    snd_pcm_uframes_t avail_min = out->wake_samples > 0 ? (snd_pcm_uframes_t)out->wake_samples : 1;
+    int err = configure_alsa_for_low_latency(out->pcm, out->format->alsa, rate, frame_size,
+                                             avail_min, &out->use_mmap);
+    if (err < 0) {
+        return err;
+    }
+
+    char stages[256];
+    if (alsa_describe_conversion(out->pcm, stages, sizeof(stages)) > 0) {
+        fprintf(stderr, "Warning: ALSA converts %s at %u Hz on the way to %s: %s\n",
+                out->format->name, rate, out->hardware[0] ? out->hardware : "the device", stages);
+    } else {
+        fprintf(stderr, "Sample format: %s at %u Hz, written to %s without conversion\n",
+                out->format->name, rate, out->hardware[0] ? out->hardware : "the device");
+    }
+    return 0;
+}
+
+// With mmap access, hand out the DMA ring when the frame fits contiguously
+static int alsa_begin(output_t *out, int frames, void **dst) {
+    out->direct = 0;
+    if (!out->use_mmap) {
+        return 0;
+    }
+    void *area;
+    int err = alsa_mmap_begin_frame(out->pcm, frames, &area, &out->mmap_offset);
+    if (err < 0) {
+        return err;
+    }
+    if (err) {
+        out->direct = 1;
+        *dst = area;
+    }
+    return 0;
+}
+
+static int alsa_commit(output_t *out, const void *buf, int frames) {
+    int written;
+    if (out->direct) {
+        written = alsa_mmap_commit_frame(out->pcm, out->mmap_offset, frames);
+    } else if (out->use_mmap) {
+        written = alsa_mmap_write(out->pcm, buf, frames);
+    } else {
+        written = snd_pcm_writei(out->pcm, buf, frames);
+    }
+    if (written >= 0) {
+        latency_frames_committed(written);
+    }
+    return written;
+}
+
+static void alsa_measure(output_t *out, struct timespec *ts, int64_t *delay_us) {
+    latency_measure(out->pcm, out->rate, ts, delay_us);
+}
+
+// snd_pcm_recover prepares the stream again after an underrun and resumes
+// it after a suspend; anything else gets a plain prepare. Fails if that does
+// too, e.g. once the card is gone.
+static int alsa_recover(output_t *out, int err) {
+    if (snd_pcm_recover(out->pcm, err, 1) < 0) {
+        err = snd_pcm_prepare(out->pcm);
+        if (err < 0) {
+            fprintf(stderr, "Cannot recover output: %s\n", snd_strerror(err));
+            return err;
+        }
+    }
+    latency_stream_reset();
+    return 0;
+}
+
+static void alsa_card_name(output_t *out, char *buf, size_t n) {
+    snd_pcm_info_t *info;
+    snd_pcm_info_alloca(&info);
+    char *name = NULL;
+
+    if (snd_pcm_info(out->pcm, info) >= 0) {
+        int card = snd_pcm_info_get_card(info);
+        if (card >= 0 && snd_card_get_name(card, &name) == 0 && name) {
+            snprintf(buf, n, "%s", name);
+            free(name);
+            return;
+        }
+    }
+    snprintf(buf, n, "%s", snd_pcm_name(out->pcm));
+}
+
+static void alsa_close(output_t *out) {
+    snd_pcm_drain(out->pcm);
+    snd_pcm_close(out->pcm);
+}
+
+static int alsa_avail(output_t *out) {
+    return (int)snd_pcm_avail_update(out->pcm);
+}
+
+static int alsa_poll_descriptors(output_t *out, struct pollfd *fds, int space) {
+    return snd_pcm_poll_descriptors(out->pcm, fds, space);
+}
+
+static int alsa_poll_revents(output_t *out, struct pollfd *fds, int n, unsigned short *revents) {
+    return snd_pcm_poll_descriptors_revents(out->pcm, fds, n, revents);
+}
+
+static const output_ops_t alsa_ops = {
+    "alsa", 0, alsa_negotiate, alsa_configure, alsa_begin, alsa_commit, alsa_measure,
+    alsa_recover, alsa_card_name, alsa_close,
+    alsa_avail, alsa_poll_descriptors, alsa_poll_revents
+};
+
+//---------- Simulated device clock (null, file and pipe sinks) ----------//
+
+static int64_t sim_now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Samples the simulated DAC has played by monotonic time now_ns. Like a sound
+// card, it underruns once it has played everything written.
+static int64_t sim_consumed(output_t *out, int64_t now_ns) {
+    if (out->start_ns == 0) {
+        return 0;
+    }
+    int64_t consumed = (now_ns - out->start_ns) * out->rate / 1000000000LL;
+    if (consumed > out->written) {
+        out->underrun = 1;
+        consumed = out->written;
+    }
+    return consumed;
+}
+
+// A simulated sink takes any format at any rate; auto means the defaults
+static int sim_negotiate(output_t *out, int format, unsigned int rate) {
+    out->format = sample_format_get(format == SAMPLE_FORMAT_AUTO ? SAMPLE_FORMAT_S16 : format);
+    out->rate = rate ? rate : DEFAULT_SAMPLE_RATE;
+    if (out->wav && out->format->alsa == SND_PCM_FORMAT_S24_LE) {
+        fprintf(stderr, "WAV files cannot hold %s, use s24_3le or a .raw file\n", out->format->name);
+        return -1;
+    }
+    return 0;
+}
+
+static int sim_configure(output_t *out, unsigned int rate, int frame_size) {
+    out->buffer_samples = (int64_t)frame_size * BUFFER_FRAMES(frames_per_period);
+    out->start_ns = 0;
+    out->written = 0;
+    out->underrun = 0;
+    if (out->wav) {
+        uint8_t header[RENDER_WAV_HEADER_MAX];
+        size_t len = render_wav_header(header, RENDER_FORMAT_WAV, rate, out->format, 0, 0, "");
+        if (write(out->fd, header, len) != (ssize_t)len) {
+            fprintf(stderr, "Cannot write WAV header to %s: %s\n", out->target, strerror(errno));
+            return -1;
+        }
+    }
+    fprintf(stderr, "Output %s: simulated clock, %s at %u Hz, buffer_size=%" PRId64 " (%.2f ms latency)\n",
+            out->ops->name, out->format->name, rate, out->buffer_samples,
+            (double)out->buffer_samples * 1000.0 / rate);
+    return 0;
+}
+
+static int sim_begin(output_t *out, int frames, void **dst) {
+    (void)out; (void)frames; (void)dst;
+    return 0;
+}
+
+// Arm the poll timer for when the simulated buffer has room for wake_samples
+static void sim_arm(output_t *out) {
+    if (out->timer_fd < 0) {
+        return;
+    }
+    int64_t wake = out->wake_samples > 0 ? out->wake_samples : 1;
+    int64_t due = out->start_ns + (out->written + wake - out->buffer_samples) * 1000000000LL / out->rate;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (out->start_ns == 0 || due <= 0) {
+        due = 1; // Already writable
+    }
+    its.it_value.tv_sec = due / 1000000000LL;
+    its.it_value.tv_nsec = due % 1000000000LL;
+    timerfd_settime(out->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Block until the simulated buffer has room, like a full ALSA ring would,
+// then hand the samples to the file or pipe
+static int sim_commit(output_t *out, const void *buf, int frames) {
+    int64_t now = sim_now_ns(CLOCK_MONOTONIC);
+    int64_t consumed = sim_consumed(out, now);
+    if (out->underrun) {
+        return -EPIPE;
+    }
+    int64_t excess = out->written + frames - out->buffer_samples - consumed;
+    if (excess > 0) {
+        int64_t due = out->start_ns + (out->written + frames - out->buffer_samples) * 1000000000LL / out->rate;
+        struct timespec ts = {due / 1000000000LL, due % 1000000000LL};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+            if (!running) return -EINTR;
+        }
+        // Woken late enough for the buffer to have run dry
+        sim_consumed(out, sim_now_ns(CLOCK_MONOTONIC));
+        if (out->underrun) {
+            return -EPIPE;
+        }
+    }
+
+    if (out->fd >= 0) {
+        const char *src = (const char*)buf;
+        size_t left = (size_t)frames * out->format->bytes;
+        while (left > 0) {
+            ssize_t w = write(out->fd, src, left);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return -errno;
+            }
+            src += w;
+            left -= (size_t)w;
+        }
+        out->data_bytes += (uint64_t)frames * out->format->bytes;
+    }
+    out->written += frames;
+    // Start playing once a whole period is queued, as the ALSA start threshold does
+    if (out->start_ns == 0 && out->written >= (int64_t)out->frame_size * frames_per_period) {
+        out->start_ns = now;
+    }
+    sim_arm(out);
+    return frames;
+}
+
+static void sim_measure(output_t *out, struct timespec *ts, int64_t *delay_us) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    int64_t queued = out->written - sim_consumed(out, sim_now_ns(CLOCK_MONOTONIC));
+    *delay_us = queued * MICROSECONDS_PER_SECOND / out->rate;
+}
+
+// An underrun restarts the simulated stream; a write error on a file or
+// pipe is final
+static int sim_recover(output_t *out, int err) {
+    if (err == -EPIPE && out->underrun) {
+        out->start_ns = 0;
+        out->written = 0;
+        out->underrun = 0;
+        sim_arm(out);
+        return 0;
+    }
+    if (err != -EINTR) {
+        fprintf(stderr, "Output %s failed: %s\n", out->target, strerror(-err));
+    }
+    return -1;
+}
+
+static void sim_card_name(output_t *out, char *buf, size_t n) {
+    snprintf(buf, n, "%s", out->ops->name);
+}
+
+static void sim_close(output_t *out) {
+    if (out->timer_fd >= 0) {
+        close(out->timer_fd);
+    }
+    if (out->fd < 0) {
+        return;
+    }
+    if (out->wav) {
+        // Patch the sizes now that the length is known
+        uint8_t header[RENDER_WAV_HEADER_MAX];
+        uint64_t bytes = out->data_bytes > UINT32_MAX - 64 ? UINT32_MAX - 64 : out->data_bytes;
+        size_t len = render_wav_header(header, RENDER_FORMAT_WAV, out->rate, out->format, bytes, 0, "");
+        if (pwrite(out->fd, header, len, 0) != (ssize_t)len) {
+            fprintf(stderr, "Cannot update WAV header in %s: %s\n", out->target, strerror(errno));
+        }
+    }
+    close(out->fd);
+}
+
+static int sim_avail(output_t *out) {
+    int64_t consumed = sim_consumed(out, sim_now_ns(CLOCK_MONOTONIC));
+    if (out->underrun) {
+        return -EPIPE;
+    }
+    return (int)(out->buffer_samples - out->written + consumed);
+}
+
+// A timerfd stands in for the sound card interrupt
+static int sim_poll_descriptors(output_t *out, struct pollfd *fds, int space) {
+    if (space < 1) {
+        return 0;
+    }
+    if (out->timer_fd < 0) {
+        out->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (out->timer_fd < 0) {
+            return -errno;
+        }
+        sim_arm(out);
+    }
+    fds[0].fd = out->timer_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    return 1;
+}
+
+static int sim_poll_revents(output_t *out, struct pollfd *fds, int n, unsigned short *revents) {
+    uint64_t expirations;
+    *revents = 0;
+    if (n > 0 && (fds[0].revents & POLLIN) &&
+        read(out->timer_fd, &expirations, sizeof(expirations)) > 0) {
+        *revents = POLLOUT;
+    }
+    return 0;
+}
+
+static const output_ops_t null_ops = {
+    "null", 1, sim_negotiate, sim_configure, sim_begin, sim_commit, sim_measure,
+    sim_recover, sim_card_name, sim_close,
+    sim_avail, sim_poll_descriptors, sim_poll_revents
+};
+
+static const output_ops_t file_ops = {
+    "file", 1, sim_negotiate, sim_configure, sim_begin, sim_commit, sim_measure,
+    sim_recover, sim_card_name, sim_close,
+    sim_avail, sim_poll_descriptors, sim_poll_revents
+};
+
+static const output_ops_t pipe_ops = {
+    "pipe", 1, sim_negotiate, sim_configure, sim_begin, sim_commit, sim_measure,
+    sim_recover, sim_card_name, sim_close,
+    sim_avail, sim_poll_descriptors, sim_poll_revents
+};
+
+int output_open(output_t *out, const char *device) {
+    memset(out, 0, sizeof(*out));
+    out->fd = -1;
+    out->timer_fd = -1;
+
+    if (strcmp(device, OUTPUT_PREFIX_NULL) == 0 ||
+        strncmp(device, OUTPUT_PREFIX_NULL ":", strlen(OUTPUT_PREFIX_NULL ":")) == 0) {
+        out->ops = &null_ops;
+        out->target = device;
+        return 0;
+    }
+
+    if (strncmp(device, OUTPUT_PREFIX_FILE, strlen(OUTPUT_PREFIX_FILE)) == 0) {
+        out->ops = &file_ops;
+        out->target = device + strlen(OUTPUT_PREFIX_FILE);
+        const char *ext = strrchr(out->target, '.');
+        out->wav = !(ext && (strcmp(ext, ".raw") == 0 || strcmp(ext, ".pcm") == 0));
+        out->fd = open(out->target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out->fd < 0) {
+            fprintf(stderr, "Cannot create %s: %s\n", out->target, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(device, OUTPUT_PREFIX_PIPE, strlen(OUTPUT_PREFIX_PIPE)) == 0) {
+        out->ops = &pipe_ops;
+        out->target = device + strlen(OUTPUT_PREFIX_PIPE);
+        // A reader going away is reported as EPIPE by write()
+        signal(SIGPIPE, SIG_IGN);
+        if (out->target[0] == 0 || strcmp(out->target, "-") == 0) {
+            // Samples own stdout; console messages move to stderr
+            out->target = "stdout";
+            out->fd = dup(STDOUT_FILENO);
+            if (out->fd >= 0) {
+                fflush(stdout);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+            }
+        } else {
+            out->fd = open(out->target, O_WRONLY); // Waits for a FIFO reader
+        }
+        if (out->fd < 0) {
+            fprintf(stderr, "Cannot open %s: %s\n", out->target, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    out->ops = &alsa_ops;
+    out->target = device;
+    int err = snd_pcm_open(&out->pcm, device, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        fprintf(stderr, "Failed to open PCM device '%s'\n", device);
+        return err;
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+#ifndef LTC_OUTPUT_H
+#define LTC_OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <poll.h>
+#include "ltc_common.h"
+#include "ltc_format.h"
+
+// Device prefixes selecting a non-ALSA sink (anything else is an ALSA PCM name)
+#define OUTPUT_PREFIX_NULL "null"    // null or null:      discard samples
+#define OUTPUT_PREFIX_FILE "file:"   // file:<path>        WAV, or raw for .raw/.pcm
+#define OUTPUT_PREFIX_PIPE "pipe:"   // pipe:<path>        raw samples to a FIFO, pipe:- for stdout
+
+// The simulated device clock used by the non-ALSA sinks matches the ALSA
+// configuration: BUFFER_FRAMES deep, starting once a period is queued and
+// underrunning when the buffer runs dry.
+
+// Backend operations. The timing code only ever talks to a sink through these.
+typedef struct {
+    const char *name;
+    int simulated;             // Paced by a simulated clock instead of a sound card
+    // Pick the sample format and rate: the given ones, or for SAMPLE_FORMAT_AUTO
+    // and a rate of 0 what the device takes without conversion
+    int  (*negotiate)(output_t *out, int format, unsigned int rate);
+    // Set up the stream and size buffers for frames of up to frame_size samples
+    int  (*configure)(output_t *out, unsigned int rate, int frame_size);
+    // Optionally point *dst at device memory for the next frame. Leaves *dst
+    // alone when the frame has to be written from the caller's buffer.
+    int  (*begin)(output_t *out, int frames, void **dst);
+    // Queue a frame rendered into the buffer from begin(). Returns the sample
+    // count or a negative error.
+    int  (*commit)(output_t *out, const void *buf, int frames);
+    // Output delay and the CLOCK_REALTIME instant it applies to
+    void (*measure)(output_t *out, struct timespec *ts, int64_t *delay_us);
+    // Recover from a begin/commit error; negative if the stream is lost
+    int  (*recover)(output_t *out, int err);
+    void (*card_name)(output_t *out, char *buf, size_t n);
+    void (*close)(output_t *out);
+    // Event loop support: samples that can be written without blocking (or a
+    // negative error), the descriptors to poll, and their decoded events
+    int  (*avail)(output_t *out);
+    int  (*poll_descriptors)(output_t *out, struct pollfd *fds, int space);
+    int  (*poll_revents)(output_t *out, struct pollfd *fds, int n, unsigned short *revents);
+} output_ops_t;
+
+struct output {
+    const output_ops_t *ops;
+    const char *target;           // PCM name or path after the prefix
+    const sample_format_t *format;
+    unsigned int rate;
+    int frame_size;
+    int wake_samples;             // Room at which poll reports writable, 0 for any
+
+    // ALSA
+    snd_pcm_t *pcm;
+    char hardware[32];            // hw:CARD,DEV probed for its native format, "" if none
+    int use_mmap;
+    int direct;                   // begin() handed out DMA memory at mmap_offset
+    snd_pcm_uframes_t mmap_offset;
+
+    // Simulated device clock
+    int fd;                       // -1 for the null sink
+    int wav;                      // File sink writes a WAV header
+    uint64_t data_bytes;
+    int64_t start_ns;             // CLOCK_MONOTONIC at which sample 0 played, 0 before start
+    int underrun;                 // Ran dry; writes fail with -EPIPE until recovered
+    int64_t written;              // Samples queued since start
+    int64_t buffer_samples;
+    int timer_fd;                 // Fires when the simulated buffer has room, -1 until polled
+
+    void *priv;                   // State of views onto another output
+};
+
+// Open the sink named by device. Returns 0 on success.
+int output_open(output_t *out, const char *device);
+
+static inline int output_negotiate(output_t *out, int format, unsigned int rate) {
+    return out->ops->negotiate(out, format, rate);
+}
+
+static inline int output_configure(output_t *out, unsigned int rate, int frame_size) {
+    out->rate = rate;
+    out->frame_size = frame_size;
+    return out->ops->configure(out, rate, frame_size);
+}
+
+static inline int output_begin(output_t *out, int frames, void **dst) {
+    return out->ops->begin(out, frames, dst);
+}
+
+static inline int output_commit(output_t *out, const void *buf, int frames) {
+    return out->ops->commit(out, buf, frames);
+}
+
+static inline void output_measure(output_t *out, struct timespec *ts, int64_t *delay_us) {
+    out->ops->measure(out, ts, delay_us);
+}
+
+static inline int output_recover(output_t *out, int err) {
+    return out->ops->recover(out, err);
+}
+
+static inline void output_card_name(output_t *out, char *buf, size_t n) {
+    out->ops->card_name(out, buf, n);
+}
+
+static inline int output_avail(output_t *out) {
+    return out->ops->avail(out);
+}
+
+static inline int output_poll_descriptors(output_t *out, struct pollfd *fds, int space) {
+    return out->ops->poll_descriptors(out, fds, space);
+}
+
+static inline int output_poll_revents(output_t *out, struct pollfd *fds, int n, unsigned short *revents) {
+    return out->ops->poll_revents(out, fds, n, revents);
+}
+
+static inline void output_close(output_t *out) {
+    out->ops->close(out);
+}
+
+#endif // LTC_OUTPUT_H
@@ -0,0 +1,403 @@
+#include "ltc_pipeline.h"
+#include "ltc_ntp.h"
+#include "ltc_calibrate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// Global variables
+int lookahead_frames = PIPELINE_DEFAULT_LOOKAHEAD;
+
+int frame_source_prepare(frame_source_t *src, output_t *timing, SMPTETimecode *tc) {
+    const rate_plan_t *plan = src->plan;
+    int samples = cadence_next(&src->cadence);
+
+    if (src->mode == TIMECODE_INCREMENTAL) {
+        get_timecode_incremental(&src->counter, &src->clock, tc, plan, timing);
+    } else if (src->mode == TIMECODE_PLL) {
+        samples = pll_next_frame(&src->pll, &src->clock, tc, plan, timing, samples);
+    } else if (src->calibrate) {
+        long tv_nsec = 0;
+        timecode_at(&src->clock, tc, plan, get_output_time_us(&src->clock, plan, timing, &tv_nsec));
+        calibration_note_frame(tc, plan, tv_nsec);
+    } else {
+        get_timecode_with_latency(&src->clock, tc, plan, timing);
+    }
+
+    if (src->encoder) {
+        ltc_encoder_set_timecode(src->encoder, tc);
+        ltc_encoder_encode_frame(src->encoder);
+
+        // Suppress deprecated warning for ltc_encoder_get_buffer
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+        int encoded = ltc_encoder_get_buffer(src->encoder, (ltcsnd_sample_t*)src->ltc_buf);
+        #pragma GCC diagnostic pop
+
+        // libltc keeps its own fractional sample count; hold the last sample
+        // if its frame came out shorter than the cadence asks for
+        if (encoded < 1) encoded = 1;
+        for (int i = encoded; i < samples; ++i) {
+            src->ltc_buf[i] = src->ltc_buf[encoded - 1];
+        }
+    }
+    return samples;
+}
+
+void frame_source_render(frame_source_t *src, const SMPTETimecode *tc, void *out, int samples) {
+    if (src->encoder) {
+        // libltc only has 8 bits to give, so widening its 16-bit conversion
+        // loses nothing
+        if (src->format->alsa == SND_PCM_FORMAT_S16_LE) {
+            src->convert->fn((int16_t*)out, src->ltc_buf, samples);
+        } else {
+            src->convert->fn(src->s16_buf, src->ltc_buf, samples);
+            src->format->from_s16(out, src->s16_buf, samples);
+        }
+    } else {
+        synth_render_frame(src->synth, tc, &src->synth_level, out, samples);
+    }
+}
+
+void frame_source_resync(frame_source_t *src, int frame) {
+    cadence_seek(&src->cadence, frame);
+    src->counter.valid = 0;
+    src->pll.valid = 0;
+}
+
+//---------- Batches of frames for one write ----------//
+
+static void batch_measure(output_t *view, struct timespec *ts, int64_t *delay_us) {
+    frame_batch_t *b = (frame_batch_t*)view->priv;
+    int64_t ns = b->ts.tv_nsec + b->offset * 1000000000LL / b->out->rate;
+    ts->tv_sec = b->ts.tv_sec + (time_t)(ns / 1000000000LL);
+    ts->tv_nsec = (long)(ns % 1000000000LL);
+    *delay_us = b->delay_us;
+}
+
+static void batch_card_name(output_t *view, char *buf, size_t n) {
+    frame_batch_t *b = (frame_batch_t*)view->priv;
+    output_card_name(b->out, buf, n);
+}
+
+static const output_ops_t batch_ops = {
+    "batch", 1, NULL, NULL, NULL, NULL, batch_measure, NULL, batch_card_name, NULL,
+    NULL, NULL, NULL
+};
+
+void frame_batch_init(frame_batch_t *b, output_t *out) {
+    memset(b, 0, sizeof(*b));
+    b->out = out;
+    b->view.ops = &batch_ops;
+    b->view.priv = b;
+    b->view.rate = out->rate;
+}
+
+int frame_batch_render(frame_batch_t *b, frame_source_t *src, void *dst, int frames) {
+    output_measure(b->out, &b->ts, &b->delay_us);
+    b->offset = 0;
+    for (int i = 0; i < frames; i++) {
+        SMPTETimecode tc;
+        int samples = frame_source_prepare(src, &b->view, &tc);
+        frame_source_render(src, &tc, (char*)dst + b->offset * src->format->bytes, samples);
+        b->offset += samples;
+    }
+    return (int)b->offset;
+}
+
+//---------- Predicted output timing for the producer ----------//
+
+// The producer renders against a view of the output whose measurement is
+// the latest anchor extrapolated to the frame being rendered. The delay is
+// kept and the clock reading advanced, so the correction table is indexed
+// by the clock reading the audio thread would have taken for this frame.
+static void view_measure(output_t *view, struct timespec *ts, int64_t *delay_us) {
+    pipeline_t *p = (pipeline_t*)view->priv;
+    int64_t ns = p->anchor.ts_nsec +
+                 (p->render_pos - p->anchor.pos) * 1000000000LL / p->out->rate;
+    ts->tv_sec = (time_t)(p->anchor.ts_sec + ns / 1000000000LL);
+    ts->tv_nsec = (long)(ns % 1000000000LL);
+    if (ts->tv_nsec < 0) {
+        ts->tv_sec--;
+        ts->tv_nsec += 1000000000L;
+    }
+    *delay_us = p->anchor.delay_us;
+}
+
+static void view_card_name(output_t *view, char *buf, size_t n) {
+    pipeline_t *p = (pipeline_t*)view->priv;
+    output_card_name(p->out, buf, n);
+}
+
+static const output_ops_t view_ops = {
+    "lookahead", 1, NULL, NULL, NULL, NULL, view_measure, NULL, view_card_name, NULL,
+    NULL, NULL, NULL
+};
+
+//---------- Ring ----------//
+
+static int64_t timespec_us(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * MICROSECONDS_PER_SECOND + ts->tv_nsec / NANOSECONDS_PER_MICROSECOND;
+}
+
+// Sleep on a ring semaphore for at most 100 ms, so stop requests are seen.
+// The deadline is on the monotonic clock: an NTP step of the wall clock must
+// not stretch or cut short the wait.
+static void pipeline_wait(sem_t *sem) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += 100000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    sem_clockwait(sem, CLOCK_MONOTONIC, &ts);
+}
+
+// Consume the posts of a semaphore whose count has run ahead: every slot
+// posts, but a side only waits once the ring is empty or full for it. The
+// caller checks the ring again before waiting, so a post that races the
+// drain is either seen there or wakes the wait.
+static void pipeline_drain(sem_t *sem) {
+    while (sem_trywait(sem) == 0) {
+    }
+}
+
+static void pipeline_publish(pipeline_t *p, const struct timespec *ts, int64_t delay_us) {
+    pipeline_anchor_t a;
+    a.epoch = p->epoch;
+    a.ts_nsec = (uint32_t)ts->tv_nsec;
+    a.ts_sec = ts->tv_sec;
+    a.pos = p->pos;
+    a.delay_us = delay_us;
+    seqlock_write(&p->anchor_lock, &a, sizeof(a));
+}
+
+// Hand the slot at the tail back to the producer
+static void pipeline_release(pipeline_t *p) {
+    p->held = 0;
+    atomic_fetch_add_explicit(&p->tail, 1, memory_order_release);
+    sem_post(&p->space);
+}
+
+static void* pipeline_thread(void *arg) {
+    pipeline_t *p = (pipeline_t*)arg;
+    uint64_t head = 0;
+
+    // Not real-time: the lookahead covers ordinary scheduling delays
+    drop_realtime(p->cpu_core);
+
+    while (!atomic_load(&p->stop)) {
+        if (head - atomic_load_explicit(&p->tail, memory_order_acquire) >= (uint64_t)p->depth) {
+            pipeline_drain(&p->space);
+            if (head - atomic_load_explicit(&p->tail, memory_order_acquire) >= (uint64_t)p->depth) {
+                pipeline_wait(&p->space);
+            }
+            continue;
+        }
+
+        pipeline_anchor_t a;
+        seqlock_read(&p->anchor_lock, &a, sizeof(a));
+        if (a.epoch != p->anchor.epoch) {
+            int frame = atomic_exchange(&p->resync_frame, -1);
+            if (frame >= 0) {
+                frame_source_resync(p->src, frame);
+            } else {
+                // Rewind to the state the source had before it last rendered
+                // the frame the audio thread now wants again
+                uint64_t oldest = head > (uint64_t)p->depth ? head - p->depth : 0;
+                for (uint64_t i = head; i-- > oldest; ) {
+                    if (p->slots[i % p->depth].pos == a.pos) {
+                        *p->src = p->history[i % p->depth];
+                        break;
+                    }
+                }
+            }
+            p->render_pos = a.pos;
+        }
+        p->anchor = a;
+
+        pipeline_slot_t *slot = &p->slots[head % p->depth];
+        p->history[head % p->depth] = *p->src;
+
+        struct timespec ts;
+        int64_t delay_us;
+        view_measure(&p->view, &ts, &delay_us);
+        slot->pos = p->render_pos;
+        slot->epoch = a.epoch;
+        slot->due_us = timespec_us(&ts) + delay_us;
+
+        // Each frame of the slot is timed from its own position in the stream
+        int samples = 0;
+        for (int i = 0; i < p->frames_per_slot; i++) {
+            SMPTETimecode tc;
+            int n = frame_source_prepare(p->src, &p->view, &tc);
+            if (i == 0) slot->correction = p->src->clock.correction;
+            frame_source_render(p->src, &tc, (char*)slot->data + (size_t)samples * p->src->format->bytes, n);
+            samples += n;
+            p->render_pos += n;
+        }
+        slot->samples = samples;
+
+        atomic_store_explicit(&p->head, ++head, memory_order_release);
+        sem_post(&p->filled);
+    }
+    return NULL;
+}
+
+int pipeline_start(pipeline_t *p, frame_source_t *src, output_t *out, int depth,
+                   int frame_size, int frames_per_slot, int cpu_core) {
+    memset(p, 0, sizeof(*p));
+    p->src = src;
+    p->cpu_core = cpu_core;
+    p->out = out;
+    p->depth = depth;
+    p->frames_per_slot = frames_per_slot;
+    p->view.ops = &view_ops;
+    p->view.priv = p;
+    p->view.rate = out->rate;
+    p->max_error_us = src->plan->us_per_frame / PIPELINE_MAX_ERROR_DIV;
+    atomic_init(&p->resync_frame, -1);
+
+    p->slots = (pipeline_slot_t*)calloc((size_t)depth, sizeof(pipeline_slot_t));
+    p->history = (frame_source_t*)calloc((size_t)depth, sizeof(frame_source_t));
+    if (!p->slots || !p->history) {
+        fprintf(stderr, "Failed to allocate lookahead pipeline\n");
+        return -1;
+    }
+    for (int i = 0; i < depth; i++) {
+        p->slots[i].pos = -1;
+        p->slots[i].data = calloc((size_t)frame_size * frames_per_slot, src->format->bytes);
+        if (!p->slots[i].data) {
+            fprintf(stderr, "Failed to allocate lookahead pipeline\n");
+            return -1;
+        }
+    }
+    sem_init(&p->filled, 0, 0);
+    sem_init(&p->space, 0, 0);
+
+    // First anchor: nothing queued yet
+    struct timespec ts;
+    int64_t delay_us;
+    output_measure(out, &ts, &delay_us);
+    pipeline_publish(p, &ts, delay_us);
+    seqlock_read(&p->anchor_lock, &p->anchor, sizeof(p->anchor));
+
+    int err = pthread_create(&p->thread, NULL, pipeline_thread, p);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start lookahead render thread: %s\n", strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+int pipeline_next(pipeline_t *p, const void **data, int *samples) {
+    int waited = 0;
+    for (;;) {
+        if (!running) {
+            return -1;
+        }
+        uint64_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+        if (tail == atomic_load_explicit(&p->head, memory_order_acquire)) {
+            if (!waited) p->waits++;
+            waited = 1;
+            pipeline_drain(&p->filled);
+            if (tail == atomic_load_explicit(&p->head, memory_order_acquire)) {
+                pipeline_wait(&p->filled);
+            }
+            continue;
+        }
+
+        pipeline_slot_t *slot = &p->slots[tail % p->depth];
+        if (slot->epoch != p->epoch || slot->pos != p->pos) {
+            pipeline_release(p); // Rendered before the last invalidation
+            continue;
+        }
+
+        // Check the frame will go out when it was rendered for. If not (xrun,
+        // clock step, producer too late), start over from here.
+        struct timespec ts;
+        int64_t delay_us;
+        output_measure(p->out, &ts, &delay_us);
+        int64_t error_us = timespec_us(&ts) + delay_us - slot->due_us;
+
+        // A newer NTP correction counts against the frame only by how far its
+        // curve has moved from the one the frame was rendered with, at the
+        // time the frame will be heard. Most syncs move it by microseconds,
+        // so the queued frames stay valid and this thread need not wait for
+        // the producer to render them again.
+        if (use_ntp) {
+            ntp_try_read_correction(&p->correction);
+            if (p->correction.generation != slot->correction.generation) {
+                int64_t heard_us = monotonic_now_us() + delay_us;
+                error_us += clock_correction_at(&p->correction, heard_us) -
+                            clock_correction_at(&slot->correction, heard_us);
+            }
+        }
+
+        if (llabs(error_us) > p->max_error_us) {
+            p->epoch++;
+            p->rerenders++;
+            pipeline_publish(p, &ts, delay_us);
+            pipeline_release(p);
+            continue;
+        }
+
+        pipeline_publish(p, &ts, delay_us);
+        p->held = 1;
+        *data = slot->data;
+        *samples = slot->samples;
+        return 0;
+    }
+}
+
+void pipeline_done(pipeline_t *p, int written) {
+    int samples = p->slots[atomic_load_explicit(&p->tail, memory_order_relaxed) % p->depth].samples;
+    if (written != samples) {
+        // A short write leaves the queued frames misaligned
+        p->pos += written;
+        pipeline_reset(p);
+        return;
+    }
+    p->pos += written;
+    pipeline_release(p);
+}
+
+void pipeline_reset(pipeline_t *p) {
+    struct timespec ts;
+    int64_t delay_us;
+    output_measure(p->out, &ts, &delay_us);
+    p->epoch++;
+    p->rerenders++;
+    pipeline_publish(p, &ts, delay_us);
+    // Recovery can also follow a failure before any frame was taken
+    if (p->held) {
+        pipeline_release(p);
+    }
+}
+
+void pipeline_resync(pipeline_t *p, int samples, int frame) {
+    struct timespec ts;
+    int64_t delay_us;
+    p->pos += samples;
+    // Set before the new epoch is published, so the producer sees it with it
+    atomic_store(&p->resync_frame, frame);
+    output_measure(p->out, &ts, &delay_us);
+    p->epoch++;
+    pipeline_publish(p, &ts, delay_us);
+}
+
+void pipeline_stop(pipeline_t *p) {
+    atomic_store(&p->stop, 1);
+    sem_post(&p->space);
+    pthread_join(p->thread, NULL);
+    for (int i = 0; i < p->depth; i++) {
+        free(p->slots[i].data);
+    }
+    free(p->slots);
+    free(p->history);
+    sem_destroy(&p->filled);
+    sem_destroy(&p->space);
+}
@@ -0,0 +1,156 @@
+#ifndef LTC_PIPELINE_H
+#define LTC_PIPELINE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include "ltc_common.h"
+#include "ltc_output.h"
+#include "ltc_pll.h"
+#include "ltc_synth.h"
+#include "ltc_convert.h"
+#include "ltc_seqlock.h"
+#include "ltc_tod.h"
+#include "ltc_discipline.h"
+
+#define PIPELINE_DEFAULT_LOOKAHEAD 4   // Frames rendered ahead of the audio thread
+#define PIPELINE_MAX_LOOKAHEAD 64
+// A frame is re-rendered when its on-wire time is off the schedule it was
+// rendered for by more than this fraction of a frame
+#define PIPELINE_MAX_ERROR_DIV 8
+
+extern int lookahead_frames;
+
+// Per-thread state for turning output time into timecode. Lives in the frame
+// source, so it belongs to whichever thread is rendering frames: the audio
+// thread, or the producer when a lookahead pipeline runs.
+struct frame_clock {
+    clock_correction_t correction; // Last consistent NTP correction snapshot
+    tod_anchor_t anchor;           // Cached local day
+};
+
+// Everything needed to produce the next LTC frame: timecode selection for
+// the configured mode followed by encoding. Owned by one thread at a time.
+typedef struct {
+    const rate_plan_t *plan;
+    frame_cadence_t cadence;
+    int mode;                      // TIMECODE_* mode
+    int calibrate;                 // Record each frame for loopback calibration
+    frame_clock_t clock;
+    tc_counter_t counter;
+    audio_pll_t pll;
+    const ltc_synth_t *synth;      // Built-in synthesizer, or
+    LTCEncoder *encoder;           // libltc encoder (NULL for built-in)
+    int synth_level;
+    int8_t *ltc_buf;               // libltc output awaiting conversion
+    const convert_kernel_t *convert;
+    const sample_format_t *format; // Output sample format
+    int16_t *s16_buf;              // libltc output converted, for formats other than S16
+} frame_source_t;
+
+// Pick the timecode and length of the next frame. timing supplies the
+// output delay the timecode is compensated for. Returns the sample count.
+int frame_source_prepare(frame_source_t *src, output_t *timing, SMPTETimecode *tc);
+
+// Encode the prepared frame into out
+void frame_source_render(frame_source_t *src, const SMPTETimecode *tc, void *out, int samples);
+
+// The stream was broken and the next frame starts on a frame boundary, frame
+// being its index within the second: take the next timecode afresh from the
+// output time, keeping the PLL frequency estimate
+void frame_source_resync(frame_source_t *src, int frame);
+
+// Several frames rendered for one write. The output is measured once per
+// batch and each frame is timed from that measurement advanced by the
+// frame's sample offset in the batch, as if it had been measured when the
+// frame was written.
+typedef struct {
+    output_t view;                 // Timing for the frame being rendered
+    output_t *out;
+    struct timespec ts;            // Measurement at the start of the batch
+    int64_t delay_us;
+    int64_t offset;                // Samples rendered so far in this batch
+} frame_batch_t;
+
+void frame_batch_init(frame_batch_t *b, output_t *out);
+
+// Render the next frames frames into dst. Returns the sample count.
+int frame_batch_render(frame_batch_t *b, frame_source_t *src, void *dst, int frames);
+
+// One pre-rendered write of frames_per_slot frames, addressed by the stream
+// sample position of its first sample
+typedef struct {
+    int64_t pos;
+    uint32_t epoch;
+    int samples;
+    int64_t due_us;                // Predicted on-wire time it was rendered for
+    clock_correction_t correction; // NTP correction curve its labels carry
+    void *data;                    // In the output's sample format
+} pipeline_slot_t;
+
+// Timing reference published by the audio thread: the output measurement
+// taken just before the frame at pos was committed. The producer predicts
+// every later frame's on-wire time from it.
+typedef struct {
+    uint32_t epoch;                // Bumped to invalidate everything rendered so far
+    uint32_t ts_nsec;
+    int64_t ts_sec;
+    int64_t pos;
+    int64_t delay_us;
+} pipeline_anchor_t;
+SEQLOCK_RECORD(pipeline_anchor_t);
+
+// Lookahead render pipeline. A producer thread pre-renders frames into a
+// single-producer single-consumer ring; the audio thread only dequeues,
+// checks each frame is still on schedule and commits it.
+typedef struct {
+    frame_source_t *src;
+    output_t *out;
+    output_t view;                 // Predicted timing for the frame being rendered
+    int depth;
+    int frames_per_slot;           // Frames per write (frames-per-period)
+    pipeline_slot_t *slots;
+    frame_source_t *history;       // Producer state before each slot, for re-rendering
+    atomic_uint_fast64_t head;     // Slots produced
+    atomic_uint_fast64_t tail;     // Slots consumed
+    sem_t filled;
+    sem_t space;
+    seqlock_t anchor_lock;
+    pipeline_anchor_t anchor;      // Producer's copy of the latest anchor
+    int64_t render_pos;            // Producer: position of the frame being rendered
+    uint32_t epoch;                // Audio thread: current epoch
+    int64_t pos;                   // Audio thread: position of the next frame to commit
+    int held;                      // Audio thread: holds the tail slot from pipeline_next
+    int64_t max_error_us;
+    clock_correction_t correction; // Audio thread: latest NTP correction snapshot
+    atomic_int resync_frame;       // Audio thread asks the producer for frame_source_resync, -1 if not
+    atomic_int stop;
+    pthread_t thread;
+    int cpu_core;                  // Audio core, which the producer stays off
+    unsigned long rerenders;       // Frames dropped and rendered again
+    unsigned long waits;           // Times the audio thread found the ring empty
+} pipeline_t;
+
+// Allocate depth slots of frames_per_slot frames of up to frame_size samples
+// each and start the producer, as a SCHED_OTHER thread off cpu_core
+int pipeline_start(pipeline_t *p, frame_source_t *src, output_t *out, int depth,
+                   int frame_size, int frames_per_slot, int cpu_core);
+
+// Audio thread: wait for the next frame that is still on schedule. Returns
+// 0 with its samples, or -1 once running is cleared.
+int pipeline_next(pipeline_t *p, const void **data, int *samples);
+
+// Audio thread: the frame from pipeline_next was committed
+void pipeline_done(pipeline_t *p, int written);
+
+// Audio thread: the output was recovered, so re-render from the current
+// frame. A frame taken from pipeline_next and not committed is dropped.
+void pipeline_reset(pipeline_t *p);
+
+// Audio thread: samples of silence were queued after an xrun, so the next
+// frame starts on a boundary; re-render from there with the source resynced
+void pipeline_resync(pipeline_t *p, int samples, int frame);
+
+void pipeline_stop(pipeline_t *p);
+
+#endif // LTC_PIPELINE_H
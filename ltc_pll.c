@@ -0,0 +1,131 @@
+#include "ltc_pll.h"
+#include "ltc_correction.h"
+#include <string.h>
+
+// Global variables
+double pll_time_constant = PLL_DEFAULT_TIME_CONSTANT;
+
+// Nominal start of frame n after the origin, from the exact rational rate
+static inline int64_t pll_frame_due_us(const audio_pll_t *pll, const rate_plan_t *plan, int64_t n) {
+    return pll->origin_us + n * plan->ltc_den * MICROSECONDS_PER_SECOND / plan->ltc_num;
+}
+
+void pll_init(audio_pll_t *pll, const rate_plan_t *plan) {
+    memset(pll, 0, sizeof(*pll));
+
+    // Critically damped second order loop with natural frequency 1 / tau,
+    // sampled once per frame
+    double frame_s = (double)plan->ltc_den / plan->ltc_num;
+    double wt = frame_s / pll_time_constant;
+    pll->kp = 2.0 * wt;
+    pll->ki = wt * wt;
+}
+
+// Restart the count at the frame boundary nearest to the output time
+static void pll_jam(audio_pll_t *pll, frame_clock_t *clock, const rate_plan_t *plan, int64_t out_us) {
+    int64_t sec_us = out_us - out_us % MICROSECONDS_PER_SECOND;
+    int64_t frac_us = out_us - sec_us;
+    int64_t index = (int64_t)(((uint64_t)frac_us * plan->frame_mult) >> RATE_FRAME_SHIFT);
+    int64_t scale = plan->ltc_den * MICROSECONDS_PER_SECOND;
+
+    // Frame boundaries within the second, rounded up so they map back to their own frame
+    int64_t start = (index * scale + plan->ltc_num - 1) / plan->ltc_num;
+    int64_t next = ((index + 1) * scale + plan->ltc_num - 1) / plan->ltc_num;
+    if (next > MICROSECONDS_PER_SECOND) next = MICROSECONDS_PER_SECOND;
+    int64_t boundary = (frac_us - start) * 2 > next - start ? next : start;
+
+    pll->origin_us = sec_us + boundary;
+    pll->frames = 0;
+    pll->residual = 0.0;
+    pll->phase_err_us = (double)(out_us - pll->origin_us);
+    timecode_at(clock, &pll->tc, plan, pll->origin_us);
+    pll->frames_until_check = resync_interval_frames;
+    pll->valid = 1;
+}
+
+int pll_next_frame(audio_pll_t *pll, frame_clock_t *clock, SMPTETimecode *tc,
+                   const rate_plan_t *plan, output_t *out, int nominal_samples) {
+    long tv_nsec = 0;
+    // The adaptive correction varies within each second; only its average is
+    // applied here so the loop does not chase a once-per-second wobble
+    int64_t out_us = get_output_time_us(clock, plan, out, &tv_nsec) + correction_table.mean_us;
+
+    if (!pll->valid) {
+        pll_jam(pll, clock, plan, out_us);
+        *tc = pll->tc;
+        return nominal_samples;
+    }
+
+    pll->frames++;
+    timecode_increment(&pll->tc, plan);
+
+    double err_us = (double)(out_us - pll_frame_due_us(pll, plan, pll->frames));
+    pll->phase_err_us = err_us;
+
+    // A step this large is an xrun or a clock step, not drift
+    int threshold = resync_threshold_frames > 0 ? resync_threshold_frames : 1;
+    int jam = err_us > (double)threshold * plan->us_per_frame ||
+              err_us < -(double)threshold * plan->us_per_frame;
+
+    // Compare the label with the wall clock every resync interval, and at
+    // midnight so the date fields roll over
+    int midnight = pll->tc.hours == 0 && pll->tc.mins == 0 &&
+                   pll->tc.secs == 0 && pll->tc.frame == 0;
+    if (!jam && (--pll->frames_until_check <= 0 || midnight)) {
+        pll->frames_until_check = resync_interval_frames;
+
+        SMPTETimecode ref;
+        timecode_at(clock, &ref, plan, pll_frame_due_us(pll, plan, pll->frames));
+        int64_t frames_per_day = plan->frames_per_day;
+        int64_t err = timecode_to_frames(&pll->tc, plan) - timecode_to_frames(&ref, plan);
+        if (err > frames_per_day / 2) err -= frames_per_day;
+        if (err < -frames_per_day / 2) err += frames_per_day;
+
+        if (llabs(err) > resync_threshold_frames) {
+            jam = 1;
+        } else {
+            pll->tc.years = ref.years;
+            pll->tc.months = ref.months;
+            pll->tc.days = ref.days;
+        }
+    }
+
+    if (jam) {
+        pll_jam(pll, clock, plan, out_us);
+        pll->jams++;
+        *tc = pll->tc;
+        return nominal_samples;
+    }
+
+    // PI loop: positive error means frames are heard late, so shorten them
+    double correction_us = pll->kp * err_us + pll->freq_us;
+    double correction = correction_us * plan->sample_rate / MICROSECONDS_PER_SECOND;
+
+    // Only integrate while the one-sample-per-frame limit is not hit, so a
+    // large initial phase error does not wind up the frequency estimate
+    if (correction < 1.0 && correction > -1.0) {
+        double max_us = PLL_MAX_PPM * 1e-6 * plan->us_per_frame;
+        pll->freq_us += pll->ki * err_us;
+        if (pll->freq_us > max_us) pll->freq_us = max_us;
+        if (pll->freq_us < -max_us) pll->freq_us = -max_us;
+    }
+
+    pll->residual += correction;
+    int adjust = 0;
+    if (pll->residual >= 1.0) {
+        adjust = -1;
+    } else if (pll->residual <= -1.0) {
+        adjust = 1;
+    }
+    pll->residual += adjust;
+    if (pll->residual > 1.0) pll->residual = 1.0;
+    if (pll->residual < -1.0) pll->residual = -1.0;
+    if (adjust) pll->adjustments++;
+
+    *tc = pll->tc;
+    return nominal_samples + adjust;
+}
+
+double pll_audio_ppm(const audio_pll_t *pll, const rate_plan_t *plan) {
+    return -pll->freq_us / (double)plan->us_per_frame * 1e6;
+}
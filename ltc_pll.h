@@ -0,0 +1,41 @@
+#ifndef LTC_PLL_H
+#define LTC_PLL_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+
+#define PLL_DEFAULT_TIME_CONSTANT 10.0  // Seconds
+#define PLL_MAX_PPM 500.0               // Largest audio clock error the loop will absorb
+
+// Audio-clock phase-locked loop. Timecode advances exactly one frame per
+// frame written, so its timing comes from the sound card's sample clock.
+// A PI loop compares when each frame will actually be heard with when it
+// should be heard and trims the frame length by one sample at a time.
+typedef struct {
+    SMPTETimecode tc;          // Timecode of the frame about to be written
+    int valid;
+    int64_t origin_us;         // Time at which frame 0 was due
+    int64_t frames;            // Frames written since the origin
+    double kp;                 // Proportional gain, per frame
+    double ki;                 // Integral gain, per frame
+    double freq_us;            // Integrator: frame shortening in us per frame
+    double residual;           // Fraction of a sample not yet applied
+    int frames_until_check;
+    double phase_err_us;       // Last measured phase error, positive when audio is late
+    unsigned long jams;
+    unsigned long adjustments; // Frames lengthened or shortened by one sample
+} audio_pll_t;
+
+extern double pll_time_constant;
+
+void pll_init(audio_pll_t *pll, const rate_plan_t *plan);
+
+// Timecode for the next frame and its length in samples, given the nominal
+// length from the cadence. The result differs from nominal by at most one.
+int pll_next_frame(audio_pll_t *pll, frame_clock_t *clock, SMPTETimecode *tc,
+                   const rate_plan_t *plan, output_t *out, int nominal_samples);
+
+// Estimated sound card clock error in ppm (negative when it runs slow)
+double pll_audio_ppm(const audio_pll_t *pll, const rate_plan_t *plan);
+
+#endif // LTC_PLL_H
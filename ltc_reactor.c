@@ -0,0 +1,307 @@
+#include "ltc_reactor.h"
+#include "ltc_tod.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+// Global variables
+int event_loop_mode = EVENT_LOOP_THREADS;
+
+// epoll tags: output descriptors are tagged with their index
+#define TAG_SIGNAL    REACTOR_MAX_PCM_FDS
+#define TAG_DISPLAY   (REACTOR_MAX_PCM_FDS + 1)
+#define TAG_NTP_TIMER (REACTOR_MAX_PCM_FDS + 2)
+#define TAG_NTP_SOCK  (REACTOR_MAX_PCM_FDS + 3)
+#define TAG_STOP      (REACTOR_MAX_PCM_FDS + 4)
+#define TAG_TZ        (REACTOR_MAX_PCM_FDS + 5)
+
+typedef struct {
+    int epfd;
+    unsigned long wakeups;
+} reactor_t;
+
+// Display refresh, NTP client and timezone watch, run on the audio reactor
+// (single) or on their own (split)
+typedef struct {
+    reactor_t reactor;
+    timecode_display_state_t *display;
+    int display_timer;
+    ntp_client_t *ntp;             // NULL without NTP
+    int tz_fd;                     // -1 without a timezone watch
+    int stop_fd;                   // Split mode: audio thread asks it to exit
+    int cpu_core;
+    pthread_t thread;
+} housekeeping_t;
+
+static int reactor_add(reactor_t *r, int fd, uint32_t events, uint32_t tag) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u32 = tag;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("Error adding descriptor to event loop");
+        return -1;
+    }
+    return 0;
+}
+
+//---------- Housekeeping ----------//
+
+static int housekeeping_open(housekeeping_t *h, reactor_t *r, const event_loop_t *loop) {
+    h->display = loop->display;
+    h->display_timer = -1;
+    h->cpu_core = loop->cpu_core;
+
+    if (h->display) {
+        // Redraw once per LTC frame instead of polling every 5 ms
+        int64_t ns = h->display->plan->us_per_frame * NANOSECONDS_PER_MICROSECOND;
+        struct itimerspec its;
+        its.it_value.tv_sec = its.it_interval.tv_sec = ns / 1000000000LL;
+        its.it_value.tv_nsec = its.it_interval.tv_nsec = ns % 1000000000LL;
+        h->display_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (h->display_timer < 0 ||
+            timerfd_settime(h->display_timer, 0, &its, NULL) < 0 ||
+            reactor_add(r, h->display_timer, EPOLLIN, TAG_DISPLAY) < 0) {
+            perror("Error creating display timer");
+            return -1;
+        }
+    }
+
+    h->ntp = loop->ntp;
+    if (h->ntp) {
+        // The client's sockets are behind its own epoll set, one descriptor here
+        if (reactor_add(r, h->ntp->timer, EPOLLIN, TAG_NTP_TIMER) < 0 ||
+            reactor_add(r, h->ntp->fd, EPOLLIN, TAG_NTP_SOCK) < 0) {
+            return -1;
+        }
+    }
+
+    h->tz_fd = loop->tz_fd;
+    if (h->tz_fd >= 0 && reactor_add(r, h->tz_fd, EPOLLIN, TAG_TZ) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void housekeeping_dispatch(housekeeping_t *h, uint32_t tag) {
+    uint64_t expirations;
+    switch (tag) {
+    case TAG_DISPLAY:
+        if (read(h->display_timer, &expirations, sizeof(expirations)) > 0) {
+            timecode_display_update(h->display);
+        }
+        break;
+    case TAG_NTP_TIMER:
+        ntp_client_on_timer(h->ntp);
+        break;
+    case TAG_NTP_SOCK:
+        ntp_client_on_reply(h->ntp);
+        break;
+    case TAG_TZ:
+        tod_tz_watch_read(h->tz_fd);
+        break;
+    }
+}
+
+static void housekeeping_close(housekeeping_t *h) {
+    if (h->display) {
+        printf("\n");
+    }
+    if (h->display_timer >= 0) close(h->display_timer);
+    if (h->stop_fd >= 0) close(h->stop_fd);
+}
+
+// Split mode: an ordinary, unpinned thread with its own epoll set
+static void* housekeeping_thread(void *arg) {
+    housekeeping_t *h = (housekeeping_t*)arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    drop_realtime(h->cpu_core);
+
+    for (;;) {
+        int n = epoll_wait(h->reactor.epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Housekeeping event loop");
+            return NULL;
+        }
+        h->reactor.wakeups++;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u32 == TAG_STOP) {
+                return NULL;
+            }
+            housekeeping_dispatch(h, events[i].data.u32);
+        }
+    }
+}
+
+//---------- Audio ----------//
+
+// Keep writing while the output has room for a whole frame. A negative avail
+// is an xrun or suspend, which write_frame recovers from.
+static int audio_service(event_loop_t *loop, struct pollfd *fds, int nfds) {
+    unsigned short revents = 0;
+    int err = output_poll_revents(loop->output, fds, nfds, &revents);
+    for (int i = 0; i < nfds; i++) {
+        fds[i].revents = 0;
+    }
+    if (err >= 0 && !(revents & (POLLOUT | POLLERR))) {
+        return 0; // Spurious wakeup, e.g. a dmix timer tick
+    }
+
+    for (;;) {
+        int avail = output_avail(loop->output);
+        if (avail >= 0 && avail < loop->frame_size) {
+            return 0;
+        }
+        int status = loop->write_frame(loop->ctx);
+        if (status != 0 || avail < 0) {
+            return status;
+        }
+    }
+}
+
+void event_loop_block_signals(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+
+int event_loop_run(event_loop_t *loop) {
+    reactor_t audio;
+    housekeeping_t hk;
+    struct pollfd fds[REACTOR_MAX_PCM_FDS];
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    struct timespec start, end;
+    int status = 0;
+    int hk_started = 0;
+
+    memset(&audio, 0, sizeof(audio));
+    memset(&hk, 0, sizeof(hk));
+    hk.reactor.epfd = -1;
+    hk.stop_fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    audio.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (audio.epfd < 0) {
+        perror("Error creating event loop");
+        return 1;
+    }
+
+    // Output: the PCM's own poll descriptors, or the simulated clock's timerfd
+    int nfds = output_poll_descriptors(loop->output, fds, REACTOR_MAX_PCM_FDS);
+    if (nfds <= 0) {
+        fprintf(stderr, "Output %s cannot be polled\n", loop->output->ops->name);
+        close(audio.epfd);
+        return 1;
+    }
+    for (int i = 0; i < nfds; i++) {
+        fds[i].revents = 0;
+        // epoll and poll event bits share values on Linux
+        if (reactor_add(&audio, fds[i].fd, fds[i].events, (uint32_t)i) < 0) {
+            close(audio.epfd);
+            return 1;
+        }
+    }
+
+    // Signals arrive as reads rather than interrupting the audio path
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    int sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd < 0 || reactor_add(&audio, sigfd, EPOLLIN, TAG_SIGNAL) < 0) {
+        perror("Error creating signalfd");
+        close(audio.epfd);
+        return 1;
+    }
+
+    reactor_t *hk_reactor = &audio;
+    if (loop->mode == EVENT_LOOP_SPLIT) {
+        hk.reactor.epfd = epoll_create1(EPOLL_CLOEXEC);
+        hk.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (hk.reactor.epfd < 0 || hk.stop_fd < 0 ||
+            reactor_add(&hk.reactor, hk.stop_fd, EPOLLIN, TAG_STOP) < 0) {
+            perror("Error creating housekeeping event loop");
+            status = 1;
+        }
+        hk_reactor = &hk.reactor;
+    }
+    if (status == 0 && housekeeping_open(&hk, hk_reactor, loop) < 0) {
+        status = 1;
+    }
+    if (status == 0 && loop->mode == EVENT_LOOP_SPLIT) {
+        int err = pthread_create(&hk.thread, NULL, housekeeping_thread, &hk);
+        if (err != 0) {
+            fprintf(stderr, "Failed to start housekeeping thread: %s\n", strerror(err));
+            status = 1;
+        } else {
+            hk_started = 1;
+        }
+    }
+
+    while (running && status == 0) {
+        int n = epoll_wait(audio.epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Event loop");
+            status = 1;
+            break;
+        }
+        audio.wakeups++;
+
+        int pcm_ready = 0;
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag < REACTOR_MAX_PCM_FDS) {
+                fds[tag].revents = (short)events[i].events;
+                pcm_ready = 1;
+            } else if (tag == TAG_SIGNAL) {
+                struct signalfd_siginfo si;
+                if (read(sigfd, &si, sizeof(si)) > 0) {
+                    running = 0;
+                }
+            } else {
+                housekeeping_dispatch(&hk, tag);
+            }
+        }
+
+        if (pcm_ready && running) {
+            int r = audio_service(loop, fds, nfds);
+            if (r < 0) {
+                status = 1;
+            } else if (r > 0) {
+                break;
+            }
+        }
+    }
+
+    if (hk_started) {
+        uint64_t one = 1;
+        if (write(hk.stop_fd, &one, sizeof(one)) < 0) {
+            perror("Error stopping housekeeping thread");
+        }
+        pthread_join(hk.thread, NULL);
+    }
+    housekeeping_close(&hk);
+    if (hk.reactor.epfd >= 0) close(hk.reactor.epfd);
+    close(sigfd);
+    close(audio.epfd);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    loop->audio_wakeups = audio.wakeups;
+    loop->housekeeping_wakeups = hk.reactor.wakeups;
+    loop->seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return status;
+}
@@ -0,0 +1,47 @@
+#ifndef LTC_REACTOR_H
+#define LTC_REACTOR_H
+
+#include "ltc_common.h"
+#include "ltc_output.h"
+#include "ltc_ntp.h"
+
+// Event loop modes
+#define EVENT_LOOP_THREADS 0   // Blocking audio loop plus display and NTP threads
+#define EVENT_LOOP_SINGLE  1   // Everything on the real-time thread's epoll loop
+#define EVENT_LOOP_SPLIT   2   // Audio and signals on the real-time thread,
+                               // display and NTP on one unpinned housekeeping thread
+
+#define REACTOR_MAX_PCM_FDS 8
+#define REACTOR_MAX_EVENTS 16
+
+extern int event_loop_mode;
+
+// Produce and commit one frame. Returns 0 to continue, 1 to stop cleanly and
+// -1 on an unrecoverable output error.
+typedef int (*event_loop_write_fn)(void *ctx);
+
+typedef struct {
+    int mode;                          // EVENT_LOOP_SINGLE or EVENT_LOOP_SPLIT
+    output_t *output;                  // Configured with wake_samples = frame_size
+    int frame_size;                    // Largest frame write_frame may commit
+    event_loop_write_fn write_frame;
+    void *ctx;
+    timecode_display_state_t *display; // NULL when the display is off
+    ntp_client_t *ntp;                 // Opened and initially synced; NULL without NTP
+    int tz_fd;                         // Timezone watch from tod_tz_watch_open, -1 for none
+    int cpu_core;                      // Core the housekeeping thread stays off
+    // Filled in by event_loop_run
+    unsigned long audio_wakeups;       // epoll returns on the real-time thread
+    unsigned long housekeeping_wakeups;
+    double seconds;
+} event_loop_t;
+
+// Signals SIGINT and SIGTERM are read from a signalfd, so they must already
+// be blocked in every thread (block them before starting any). Runs until
+// running is cleared or write_frame fails. Returns the exit status.
+int event_loop_run(event_loop_t *loop);
+
+// Block SIGINT and SIGTERM in the calling thread and threads it creates
+void event_loop_block_signals(void);
+
+#endif // LTC_REACTOR_H
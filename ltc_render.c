@@ -0,0 +1,316 @@
+#include "ltc_render.h"
+#include "ltc_synth.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdatomic.h>
+
+// Global variables
+render_options_t render_options = {NULL, RENDER_FORMAT_AUTO, "00:00:00:00", 60.0, 0};
+
+// Shared by all render threads. Chunks are claimed with an atomic counter
+// and written with pwrite at their own offset, so no other locking is needed.
+typedef struct {
+    const ltc_synth_t *synth;
+    const rate_plan_t *plan;
+    int fd;
+    int64_t data_offset;       // File offset of the first sample
+    int64_t first_frame;       // Frames since midnight of the first frame
+    int64_t total_frames;
+    int64_t chunk_frames;
+    int chunks;
+    atomic_int next_chunk;
+    atomic_int failed;
+    int *end_level;            // Biphase level after each chunk, for the seam check
+} render_job_t;
+
+int parse_render_format(const char *val) {
+    if (strcmp(val, "auto") == 0) return RENDER_FORMAT_AUTO;
+    if (strcmp(val, "wav") == 0) return RENDER_FORMAT_WAV;
+    if (strcmp(val, "bwf") == 0) return RENDER_FORMAT_BWF;
+    if (strcmp(val, "raw") == 0) return RENDER_FORMAT_RAW;
+    return -1;
+}
+
+int parse_timecode(const char *s, SMPTETimecode *tc, const rate_plan_t *plan) {
+    int h, m, sec, f;
+    char sep;
+    if (sscanf(s, "%d:%d:%d%c%d", &h, &m, &sec, &sep, &f) != 5 ||
+        (sep != ':' && sep != ';' && sep != '.')) {
+        return -1;
+    }
+    if (h < 0 || h > 23 || m < 0 || m > 59 || sec < 0 || sec > 59 ||
+        f < 0 || f >= plan->frames_per_second) {
+        return -1;
+    }
+    // Frames 0 and 1 do not exist at the start of most drop-frame minutes
+    if (plan->spec->drop_frame && sec == 0 && f < 2 && m % 10 != 0) {
+        return -1;
+    }
+    memset(tc, 0, sizeof(*tc));
+    tc->hours = (unsigned char)h;
+    tc->mins = (unsigned char)m;
+    tc->secs = (unsigned char)sec;
+    tc->frame = (unsigned char)f;
+    return 0;
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+size_t render_wav_header(uint8_t *buf, int format, unsigned int sample_rate, const sample_format_t *sample,
+                         uint64_t data_bytes, uint64_t time_reference, const char *description) {
+    size_t bext = format == RENDER_FORMAT_BWF ? 8 + RENDER_BEXT_SIZE : 0;
+    size_t len = 12 + bext + 8 + 16 + 8;
+    memset(buf, 0, len);
+
+    memcpy(buf, "RIFF", 4);
+    put_le32(buf + 4, (uint32_t)(len - 8 + data_bytes));
+    memcpy(buf + 8, "WAVE", 4);
+    uint8_t *p = buf + 12;
+
+    if (bext) {
+        time_t now = time(NULL);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        memcpy(p, "bext", 4);
+        put_le32(p + 4, RENDER_BEXT_SIZE);
+        uint8_t *b = p + 8;
+        snprintf((char*)b, 256, "%s", description);
+        memcpy(b + 256, "ltc_timecode_pi", 15);
+        char stamp[80];
+        snprintf(stamp, sizeof(stamp), "%04d-%02d-%02d%02d-%02d-%02d",
+                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        memcpy(b + 320, stamp, 18);                    // OriginationDate + OriginationTime
+        put_le32(b + 338, (uint32_t)time_reference);   // TimeReferenceLow
+        put_le32(b + 342, (uint32_t)(time_reference >> 32));
+        put_le16(b + 346, 1);                          // Version
+        p += bext;
+    }
+
+    memcpy(p, "fmt ", 4);
+    put_le32(p + 4, 16);
+    put_le16(p + 8, sample->alsa == SND_PCM_FORMAT_FLOAT_LE ? 3 : 1);   // IEEE float or PCM
+    put_le16(p + 10, CHANNELS);
+    put_le32(p + 12, sample_rate);
+    put_le32(p + 16, sample_rate * CHANNELS * sample->bytes);
+    put_le16(p + 20, CHANNELS * sample->bytes);
+    put_le16(p + 22, sample->bytes * 8);
+    memcpy(p + 24, "data", 4);
+    put_le32(p + 28, (uint32_t)data_bytes);
+    return len;
+}
+
+static void* render_thread(void *arg) {
+    render_job_t *job = (render_job_t*)arg;
+    const rate_plan_t *plan = job->plan;
+    int16_t *buf = (int16_t*)malloc((size_t)job->chunk_frames * cadence_max(&plan->cadence) * sizeof(int16_t));
+    if (!buf) {
+        atomic_store(&job->failed, 1);
+        return NULL;
+    }
+
+    int chunk;
+    while (!atomic_load(&job->failed) &&
+           (chunk = atomic_fetch_add(&job->next_chunk, 1)) < job->chunks) {
+        int64_t first = (int64_t)chunk * job->chunk_frames;
+        int64_t frames = job->total_frames - first;
+        if (frames > job->chunk_frames) frames = job->chunk_frames;
+
+        // Every chunk starts from the cadence phase, timecode and sample
+        // position it would have had in one continuous run. The parity bit
+        // keeps the number of zero bits per frame even, so the biphase level
+        // at every frame start is the same and each chunk can start low.
+        frame_cadence_t cadence = plan->cadence;
+        cadence_seek(&cadence, job->first_frame + first);
+        SMPTETimecode tc;
+        memset(&tc, 0, sizeof(tc));
+        timecode_from_frames(&tc, plan, job->first_frame + first);
+        int level = 0;
+
+        size_t pos = 0;
+        for (int64_t i = 0; i < frames; i++) {
+            int n = cadence_next(&cadence);
+            synth_render_frame(job->synth, &tc, &level, buf + pos, n);
+            pos += n;
+            timecode_increment(&tc, plan);
+        }
+        job->end_level[chunk] = level;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (size_t i = 0; i < pos; i++) {
+            buf[i] = (int16_t)__builtin_bswap16((uint16_t)buf[i]);
+        }
+#endif
+
+        int64_t sample = cadence_position(&plan->cadence, job->first_frame + first) -
+                         cadence_position(&plan->cadence, job->first_frame);
+        const char *src = (const char*)buf;
+        size_t left = pos * sizeof(int16_t);
+        off_t offset = (off_t)(job->data_offset + sample * (int64_t)sizeof(int16_t));
+        while (left > 0) {
+            ssize_t w = pwrite(job->fd, src, left, offset);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                perror("Error writing render output");
+                atomic_store(&job->failed, 1);
+                break;
+            }
+            src += w;
+            left -= (size_t)w;
+            offset += w;
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static void render_format_timecode(char *buf, size_t n, const SMPTETimecode *tc, const rate_plan_t *plan) {
+    snprintf(buf, n, "%02d:%02d:%02d%c%02d", tc->hours, tc->mins, tc->secs,
+             plan->spec->drop_frame ? ';' : ':', tc->frame);
+}
+
+static int64_t render_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int run_render(const render_options_t *opt, const rate_plan_t *plan) {
+    SMPTETimecode start;
+    if (parse_timecode(opt->start, &start, plan) < 0) {
+        fprintf(stderr, "Invalid start timecode '%s' for %s fps\n", opt->start, plan->spec->name);
+        return 1;
+    }
+    if (opt->duration_s <= 0.0) {
+        fprintf(stderr, "Render duration must be positive\n");
+        return 1;
+    }
+
+    int format = opt->format;
+    if (format == RENDER_FORMAT_AUTO) {
+        const char *ext = strrchr(opt->path, '.');
+        format = (ext && (strcmp(ext, ".raw") == 0 || strcmp(ext, ".pcm") == 0)) ?
+                 RENDER_FORMAT_RAW : RENDER_FORMAT_BWF;
+    }
+
+    render_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.plan = plan;
+    job.first_frame = timecode_to_frames(&start, plan);
+    job.total_frames = (int64_t)(opt->duration_s * plan->ltc_num / plan->ltc_den + 0.5);
+    if (job.total_frames < 1) job.total_frames = 1;
+    job.chunk_frames = (int64_t)plan->frames_per_second * RENDER_CHUNK_SECONDS;
+    job.chunks = (int)((job.total_frames + job.chunk_frames - 1) / job.chunk_frames);
+
+    uint64_t samples = (uint64_t)(cadence_position(&plan->cadence, job.first_frame + job.total_frames) -
+                                  cadence_position(&plan->cadence, job.first_frame));
+    uint64_t data_bytes = samples * sizeof(int16_t);
+    if (format != RENDER_FORMAT_RAW && data_bytes > UINT32_MAX - 1024) {
+        fprintf(stderr, "Render too long for a WAV file, use a .raw output\n");
+        return 1;
+    }
+
+    // Files are always 16-bit
+    const sample_format_t *sample = sample_format_get(SAMPLE_FORMAT_S16);
+    ltc_synth_t synth;
+    if (synth_init(&synth, plan->sample_rate, plan->cadence.base, plan->spec, sample, SYNTH_DEFAULT_AMPLITUDE) < 0) {
+        return 1;
+    }
+    job.synth = &synth;
+
+    job.fd = open(opt->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job.fd < 0) {
+        fprintf(stderr, "Cannot create %s: %s\n", opt->path, strerror(errno));
+        synth_free(&synth);
+        return 1;
+    }
+
+    if (format != RENDER_FORMAT_RAW) {
+        uint8_t header[RENDER_WAV_HEADER_MAX];
+        char description[128];
+        snprintf(description, sizeof(description), "LTC %s fps from %s", plan->spec->name, opt->start);
+        uint64_t time_reference = (uint64_t)cadence_position(&plan->cadence, job.first_frame);
+        size_t len = render_wav_header(header, format, plan->sample_rate, sample, data_bytes, time_reference, description);
+        if (write(job.fd, header, len) != (ssize_t)len) {
+            fprintf(stderr, "Cannot write header to %s: %s\n", opt->path, strerror(errno));
+            close(job.fd);
+            synth_free(&synth);
+            return 1;
+        }
+        job.data_offset = (int64_t)len;
+    }
+
+    int threads = opt->threads > 0 ? opt->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > job.chunks) threads = job.chunks;
+
+    job.end_level = (int*)calloc((size_t)job.chunks, sizeof(int));
+    pthread_t *tids = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+    if (!job.end_level || !tids) {
+        fprintf(stderr, "Failed to allocate render state\n");
+        close(job.fd);
+        synth_free(&synth);
+        free(job.end_level);
+        free(tids);
+        return 1;
+    }
+
+    int64_t t0 = render_now_ns();
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&tids[started], NULL, render_thread, &job) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        render_thread(&job); // Render on this thread instead
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed = (double)(render_now_ns() - t0) / 1e9;
+
+    // Every chunk must end on the level the next one assumed at its start
+    int seams = 0;
+    for (int i = 0; i < job.chunks; i++) {
+        if (job.end_level[i] != 0) seams++;
+    }
+
+    int failed = atomic_load(&job.failed) || close(job.fd) != 0;
+    free(job.end_level);
+    free(tids);
+    synth_free(&synth);
+
+    if (failed) {
+        fprintf(stderr, "Render to %s failed\n", opt->path);
+        return 1;
+    }
+    if (seams) {
+        fprintf(stderr, "Warning: %d chunk seams with a biphase polarity mismatch\n", seams);
+        return 1;
+    }
+
+    SMPTETimecode end;
+    char first_buf[32], last_buf[32];
+    timecode_from_frames(&end, plan, job.first_frame + job.total_frames - 1);
+    render_format_timecode(first_buf, sizeof(first_buf), &start, plan);
+    render_format_timecode(last_buf, sizeof(last_buf), &end, plan);
+    double seconds = (double)job.total_frames * plan->ltc_den / plan->ltc_num;
+    printf("Rendered %" PRId64 " frames (%s - %s) to %s\n", job.total_frames, first_buf, last_buf, opt->path);
+    printf("%.0f frames/s, %.0fx real time, %d thread%s, %.2f s\n",
+           job.total_frames / elapsed, seconds / elapsed, started ? started : 1, started == 1 ? "" : "s", elapsed);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef LTC_RENDER_H
+#define LTC_RENDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ltc_common.h"
+#include "ltc_format.h"
+
+// Output container (render-format option)
+#define RENDER_FORMAT_AUTO 0   // From the file extension: .raw/.pcm raw, otherwise BWF
+#define RENDER_FORMAT_WAV  1
+#define RENDER_FORMAT_BWF  2   // WAV with a bext chunk carrying the start as time_reference
+#define RENDER_FORMAT_RAW  3   // Headerless signed 16-bit little-endian mono
+
+#define RENDER_CHUNK_SECONDS 10     // Work unit handed to each render thread
+#define RENDER_MAX_THREADS 64       // Upper bound of the render-threads option
+#define RENDER_BEXT_SIZE 602        // EBU Tech 3285 bext chunk without coding history
+#define RENDER_WAV_HEADER_MAX (12 + 8 + RENDER_BEXT_SIZE + 32)
+
+typedef struct {
+    const char *path;          // NULL when not rendering
+    int format;
+    const char *start;         // Start timecode HH:MM:SS:FF
+    double duration_s;
+    int threads;               // 0 = one per online CPU
+} render_options_t;
+
+extern render_options_t render_options;
+
+int parse_render_format(const char *val);
+
+// Parse HH:MM:SS:FF (';' or '.' also accepted before the frames) for the
+// plan's rate. Returns -1 for malformed or non-existent timecodes.
+int parse_timecode(const char *s, SMPTETimecode *tc, const rate_plan_t *plan);
+
+// Build a mono WAV header for samples in the given format (with a bext
+// chunk for RENDER_FORMAT_BWF) in buf and return its length. time_reference
+// is the first sample's position in samples since midnight. S24_LE has no
+// WAV equivalent.
+size_t render_wav_header(uint8_t *buf, int format, unsigned int sample_rate, const sample_format_t *sample,
+                         uint64_t data_bytes, uint64_t time_reference, const char *description);
+
+// Render LTC for the requested range to a file as fast as the CPUs allow.
+// Returns 0 on success.
+int run_render(const render_options_t *opt, const rate_plan_t *plan);
+
+#endif // LTC_RENDER_H
@@ -0,0 +1,47 @@
+#include "ltc_seqlock.h"
+#include <string.h>
+#include <sched.h>
+
+void seqlock_write(seqlock_t *lock, const void *data, size_t size) {
+    uint32_t words[SEQLOCK_MAX_WORDS];
+    size_t count = size / sizeof(uint32_t);
+    memcpy(words, data, count * sizeof(uint32_t));
+
+    // Odd sequence marks a write in progress
+    unsigned int seq = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+    atomic_store_explicit(&lock->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (size_t i = 0; i < count; i++) {
+        atomic_store_explicit(&lock->words[i], words[i], memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&lock->seq, seq + 2, memory_order_release);
+}
+
+int seqlock_try_read(seqlock_t *lock, void *data, size_t size) {
+    uint32_t words[SEQLOCK_MAX_WORDS];
+    size_t count = size / sizeof(uint32_t);
+
+    unsigned int before = atomic_load_explicit(&lock->seq, memory_order_acquire);
+    if (before & 1) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        words[i] = atomic_load_explicit(&lock->words[i], memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    unsigned int after = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+    if (before != after) {
+        return -1;
+    }
+
+    memcpy(data, words, count * sizeof(uint32_t));
+    return 0;
+}
+
+void seqlock_read(seqlock_t *lock, void *data, size_t size) {
+    while (seqlock_try_read(lock, data, size) != 0) {
+        sched_yield(); // Let a preempted writer finish
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef LTC_SEQLOCK_H
+#define LTC_SEQLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SEQLOCK_MAX_WORDS 8
+
+// Single-writer sequence lock for publishing small records between threads.
+// The payload is stored as 32-bit atomic words so it stays lock-free on
+// 32-bit ARM without 64-bit atomics. Records must be a multiple of 4 bytes
+// and at most SEQLOCK_MAX_WORDS words; check each record type with
+// SEQLOCK_RECORD where its lock is declared.
+typedef struct {
+    atomic_uint seq;
+    _Atomic uint32_t words[SEQLOCK_MAX_WORDS];
+} seqlock_t;
+
+#define SEQLOCK_RECORD(type) \
+    _Static_assert(sizeof(type) <= SEQLOCK_MAX_WORDS * sizeof(uint32_t) && \
+                   sizeof(type) % sizeof(uint32_t) == 0, #type " does not fit a seqlock")
+
+// Publish a new record (single writer only, never blocks)
+void seqlock_write(seqlock_t *lock, const void *data, size_t size);
+
+// Take one snapshot attempt. Returns 0 and fills data if the snapshot is
+// consistent, -1 (leaving data untouched) if a write was in progress.
+// Bounded time, so safe to call from the real-time audio thread.
+int seqlock_try_read(seqlock_t *lock, void *data, size_t size);
+
+// Retry until a consistent snapshot is obtained (non real-time readers)
+void seqlock_read(seqlock_t *lock, void *data, size_t size);
+
+#endif // LTC_SEQLOCK_H
@@ -0,0 +1,190 @@
+#include "ltc_state.h"
+#include "ltc_output.h"
+#include "ltc_ntp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+// Global variables
+char state_file[256] = STATE_DEFAULT_FILE;
+
+// Written by the NTP client between syncs and by main once it has stopped
+static saved_state_t current = { .sample_format = -1 };
+static int64_t last_save_us;
+
+static int64_t realtime_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * MICROSECONDS_PER_SECOND + ts.tv_nsec / NANOSECONDS_PER_MICROSECOND;
+}
+
+static void read_boot_id(char *buf, size_t n) {
+    buf[0] = 0;
+    FILE *f = fopen(BOOT_ID_PATH, "r");
+    if (f == NULL) {
+        return;
+    }
+    if (fgets(buf, (int)n, f) == NULL) {
+        buf[0] = 0;
+    }
+    buf[strcspn(buf, "\r\n")] = 0;
+    fclose(f);
+}
+
+static int format_by_name(const char *name) {
+    for (int i = 0; i < NUM_SAMPLE_FORMATS; i++) {
+        if (strcmp(sample_formats[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int state_load(saved_state_t *s) {
+    char line[MAX_LINE];
+    memset(s, 0, sizeof(*s));
+    s->sample_format = -1;
+    if (state_file[0] == 0) {
+        return -1;
+    }
+    FILE *f = fopen(state_file, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    int found = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char *eq = strchr(line, '=');
+        if (!eq) continue;
+        *eq = 0;
+        char *val = eq + 1;
+        val[strcspn(val, "\r\n")] = 0;
+        found = 1;
+        if (strcmp(line, "frequency-ppb") == 0) {
+            s->freq_ppb = (int32_t)strtol(val, NULL, 10);
+            s->has_clock = 1;
+        } else if (strcmp(line, "correction-us") == 0) {
+            s->correction_us = strtoll(val, NULL, 10);
+        } else if (strcmp(line, "boot-id") == 0) {
+            snprintf(s->boot_id, sizeof(s->boot_id), "%s", val);
+        } else if (strcmp(line, "clock-time-us") == 0) {
+            s->clock_time_us = strtoll(val, NULL, 10);
+        } else if (strcmp(line, "clock-monotonic-us") == 0) {
+            s->clock_mono_us = strtoll(val, NULL, 10);
+        } else if (strcmp(line, "card") == 0) {
+            snprintf(s->card, sizeof(s->card), "%s", val);
+        } else if (strcmp(line, "sample-format") == 0) {
+            s->sample_format = format_by_name(val);
+        } else if (strcmp(line, "sample-rate") == 0) {
+            s->sample_rate = (unsigned int)strtoul(val, NULL, 10);
+        }
+    }
+    fclose(f);
+
+    if (s->freq_ppb > DISCIPLINE_MAX_FREQ_PPB || s->freq_ppb < -DISCIPLINE_MAX_FREQ_PPB) {
+        fprintf(stderr, "Warning: Ignoring out of range frequency in %s\n", state_file);
+        s->has_clock = 0;
+    }
+    if (!found) {
+        return -1;
+    }
+    current = *s;
+    return 0;
+}
+
+int state_same_boot(const saved_state_t *s) {
+    char boot_id[sizeof(s->boot_id)];
+    read_boot_id(boot_id, sizeof(boot_id));
+    if (!s->has_clock || boot_id[0] == 0 || strcmp(boot_id, s->boot_id) != 0) {
+        return 0;
+    }
+    int64_t age_us = monotonic_now_us() - s->clock_mono_us;
+    if (age_us < 0 || age_us >= (int64_t)STATE_MAX_OFFSET_AGE_S * MICROSECONDS_PER_SECOND) {
+        return 0;
+    }
+    // Slewing moves both clocks alike, so any difference is a step of the
+    // system clock, which the offset was measured against
+    int64_t step_us = realtime_now_us() - s->clock_time_us - age_us;
+    if (llabs(step_us) > STATE_MAX_CLOCK_STEP_US) {
+        fprintf(stderr, "System clock stepped by %" PRId64 " microseconds since the state was saved, not restoring the offset\n", step_us);
+        return 0;
+    }
+    return 1;
+}
+
+int64_t state_offset_now(const saved_state_t *s) {
+    int64_t elapsed = monotonic_now_us() - s->clock_mono_us;
+    return s->correction_us + elapsed * s->freq_ppb / 1000000000LL;
+}
+
+void state_note_output(output_t *out) {
+    output_card_name(out, current.card, sizeof(current.card));
+    current.sample_format = (int)(out->format - sample_formats);
+    current.sample_rate = out->rate;
+}
+
+int state_note_clock(const clock_discipline_t *d) {
+    // A frequency still being measured is not worth keeping
+    if (d->state != DISCIPLINE_SYNC) {
+        return 0;
+    }
+    int64_t now = monotonic_now_us();
+    current.has_clock = 1;
+    current.freq_ppb = d->correction.freq_ppb;
+    current.correction_us = clock_correction_at(&d->correction, now);
+    read_boot_id(current.boot_id, sizeof(current.boot_id));
+    current.clock_time_us = realtime_now_us();
+    current.clock_mono_us = now;
+
+    // A failed save also waits for the next interval
+    if (state_file[0] != 0 && (last_save_us == 0 ||
+        now - last_save_us >= (int64_t)STATE_SAVE_INTERVAL_S * MICROSECONDS_PER_SECOND)) {
+        last_save_us = now;
+        return 1;
+    }
+    return 0;
+}
+
+void state_copy(saved_state_t *s) {
+    *s = current;
+}
+
+int state_save(void) {
+    return state_write(&current);
+}
+
+int state_write(const saved_state_t *s) {
+    if (state_file[0] == 0) {
+        return 0;
+    }
+    char tmp[sizeof(state_file) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", state_file);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot write state file %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "# ltc_timecode_pi state, restored at startup\n");
+    if (s->has_clock) {
+        fprintf(f, "frequency-ppb=%" PRId32 "\n", s->freq_ppb);
+        fprintf(f, "correction-us=%" PRId64 "\n", s->correction_us);
+        fprintf(f, "boot-id=%s\n", s->boot_id);
+        fprintf(f, "clock-time-us=%" PRId64 "\n", s->clock_time_us);
+        fprintf(f, "clock-monotonic-us=%" PRId64 "\n", s->clock_mono_us);
+    }
+    if (s->sample_format >= 0) {
+        fprintf(f, "card=%s\n", s->card);
+        fprintf(f, "sample-format=%s\n", sample_formats[s->sample_format].name);
+        fprintf(f, "sample-rate=%u\n", s->sample_rate);
+    }
+    if (fclose(f) != 0 || rename(tmp, state_file) != 0) {
+        fprintf(stderr, "Cannot write state file %s: %s\n", state_file, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
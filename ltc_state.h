@@ -0,0 +1,56 @@
+#ifndef LTC_STATE_H
+#define LTC_STATE_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+#include "ltc_discipline.h"
+
+#define STATE_DEFAULT_FILE "/var/lib/ltc_timecode_pi/state"
+#define STATE_SAVE_INTERVAL_S 900        // Between saves while NTP is disciplining
+#define STATE_MAX_OFFSET_AGE_S 3600      // Older offsets are not restored
+#define STATE_MAX_CLOCK_STEP_US 1000     // Larger system clock steps since the save void the offset
+
+// What a previous run learned, restored at startup so output starts with a
+// good correction instead of none. The frequency is a property of the
+// board's crystal and is kept across reboots; the offset is only
+// meaningful for the system clock it was measured against, so it is only
+// restored within the same boot and if that clock has not been stepped since.
+typedef struct {
+    int has_clock;                  // The discipline had measured a frequency
+    int32_t freq_ppb;
+    int64_t correction_us;          // Correction being applied at clock_mono_us
+    char boot_id[40];               // /proc/sys/kernel/random/boot_id then
+    int64_t clock_time_us;          // CLOCK_REALTIME then
+    int64_t clock_mono_us;          // CLOCK_MONOTONIC then
+    char card[128];                 // Output the format and rate were negotiated for
+    int sample_format;              // SAMPLE_FORMAT_*, -1 if none saved
+    unsigned int sample_rate;
+} saved_state_t;
+
+extern char state_file[256];        // Empty to neither load nor save
+
+// Read state_file. Returns 0 if it held a state, -1 if none. The state also
+// becomes the base of later saves, so what this run does not learn is kept.
+int state_load(saved_state_t *s);
+
+// Whether s was saved during this boot, recently enough and with the system
+// clock unstepped since, to restore its offset
+int state_same_boot(const saved_state_t *s);
+
+// Correction s was applying, carried forward at its frequency to now
+int64_t state_offset_now(const saved_state_t *s);
+
+// Record the negotiated output, or the discipline after an update.
+// state_note_clock returns 1 every STATE_SAVE_INTERVAL_S once the
+// discipline has a frequency, for the caller to save a state_copy with
+// state_write off the real-time path.
+void state_note_output(output_t *out);
+int state_note_clock(const clock_discipline_t *d);
+void state_copy(saved_state_t *s);
+
+// Write s, or what has been recorded, to state_file, atomically. Returns 0
+// on success.
+int state_write(const saved_state_t *s);
+int state_save(void);
+
+#endif // LTC_STATE_H
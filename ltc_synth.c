@@ -0,0 +1,164 @@
+#include "ltc_synth.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Global variables
+int encoder_mode = ENCODER_BUILTIN;
+
+// Fill n samples moving from one level to another, with a short linear edge
+static void fill_level(int32_t *dst, int n, int32_t from, int32_t to, int ramp) {
+    int i = 0;
+    for (; i < ramp && i < n; i++) {
+        dst[i] = (int32_t)(from + ((int64_t)to - from) * (i + 1) / (ramp + 1));
+    }
+    for (; i < n; i++) {
+        dst[i] = to;
+    }
+}
+
+// Render one biphase-mark bit cell. Every cell starts with a transition to
+// `level`; a logical 1 adds a second transition half way through the cell.
+static void fill_cell(int32_t *dst, int len, int bit, int level, int32_t amplitude, int ramp) {
+    int32_t hi = level ? amplitude : -amplitude;
+    int first = bit ? len / 2 : len;
+
+    fill_level(dst, first, -hi, hi, ramp);
+    if (bit) {
+        fill_level(dst + first, len - first, hi, -hi, ramp);
+    }
+}
+
+// Render a cell in the output format, for the odd lengths no template covers
+static void store_cell(const ltc_synth_t *s, uint8_t *dst, int len, int bit, int level) {
+    int32_t cell[SYNTH_MAX_CELL];
+    fill_cell(cell, len, bit, level, s->amplitude, s->ramp);
+    s->format->store(dst, cell, len);
+}
+
+static inline const uint8_t *bit_template(const ltc_synth_t *s, int len_index, int bit, int level) {
+    return s->bit_tmpl + (size_t)((len_index * 2 + bit) * 2 + level) * (s->cell_len + 1) * s->format->bytes;
+}
+
+int synth_init(ltc_synth_t *s, unsigned int sample_rate, int frame_samples,
+               const framerate_spec_t *rate, const sample_format_t *format, int16_t amplitude) {
+    memset(s, 0, sizeof(*s));
+    s->std = rate->std;
+    s->drop_frame = rate->drop_frame;
+    s->format = format;
+    s->amplitude = (int32_t)((int64_t)amplitude * format->max / INT16_MAX);
+    s->cell_len = frame_samples / SYNTH_BITS_PER_FRAME;
+    if (s->cell_len < 2) {
+        fprintf(stderr, "Sample rate %u too low for LTC synthesis\n", sample_rate);
+        return -1;
+    }
+    // Cells may come out up to two samples longer when the PLL stretches a frame
+    if (s->cell_len + 2 > SYNTH_MAX_CELL) {
+        fprintf(stderr, "Sample rate %u too high for LTC synthesis\n", sample_rate);
+        return -1;
+    }
+    size_t bytes = (size_t)format->bytes;
+
+    // Edge length from the SMPTE rise time, kept well inside a half cell
+    s->ramp = (int)((SYNTH_RISE_TIME_US * (int64_t)sample_rate + MICROSECONDS_PER_SECOND / 2) / MICROSECONDS_PER_SECOND);
+    if (s->ramp > s->cell_len / 4) s->ramp = s->cell_len / 4;
+    if (s->ramp < 1) s->ramp = 1;
+
+    // Bit templates for both cell lengths that occur when frames are not a
+    // multiple of 80 samples, for each bit value and starting level
+    size_t stride = (size_t)s->cell_len + 1;
+    s->bit_tmpl = (uint8_t*)calloc(2 * 2 * 2 * stride, bytes);
+    if (!s->bit_tmpl) {
+        fprintf(stderr, "Failed to allocate LTC bit templates\n");
+        return -1;
+    }
+    for (int li = 0; li < 2; li++) {
+        for (int bit = 0; bit < 2; bit++) {
+            for (int level = 0; level < 2; level++) {
+                store_cell(s, (uint8_t*)bit_template(s, li, bit, level), s->cell_len + li, bit, level);
+            }
+        }
+    }
+
+    // Whole-byte templates are only usable when every bit cell has the same length
+    if (frame_samples % SYNTH_BITS_PER_FRAME == 0) {
+        s->byte_len = s->cell_len * 8;
+        s->byte_tmpl = (uint8_t*)malloc((size_t)256 * 2 * s->byte_len * bytes);
+        if (!s->byte_tmpl) {
+            fprintf(stderr, "Failed to allocate LTC byte templates\n");
+            synth_free(s);
+            return -1;
+        }
+        for (int byte = 0; byte < 256; byte++) {
+            for (int start = 0; start < 2; start++) {
+                uint8_t *dst = s->byte_tmpl + ((size_t)byte * 2 + start) * s->byte_len * bytes;
+                int level = start;
+                // LTC bytes go out least significant bit first
+                for (int b = 0; b < 8; b++) {
+                    int bit = (byte >> b) & 1;
+                    memcpy(dst, bit_template(s, 0, bit, level), s->cell_len * bytes);
+                    dst += s->cell_len * bytes;
+                    level = bit ? level : !level;
+                }
+                s->byte_next_level[byte][start] = (uint8_t)level;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void synth_free(ltc_synth_t *s) {
+    free(s->bit_tmpl);
+    free(s->byte_tmpl);
+    s->bit_tmpl = NULL;
+    s->byte_tmpl = NULL;
+}
+
+// Pack a timecode into the 80-bit LTC word, including the drop-frame flag
+// and the biphase polarity correction bit
+void synth_build_frame(const ltc_synth_t *s, const SMPTETimecode *tc, LTCFrame *frame) {
+    ltc_frame_reset(frame);
+    ltc_time_to_frame(frame, (SMPTETimecode*)tc, s->std, 0);
+    frame->dfbit = s->drop_frame ? 1 : 0;
+    ltc_frame_set_parity(frame, s->std);
+}
+
+// Render one LTC frame of nsamples samples by concatenating templates.
+// *level carries the biphase polarity from one frame to the next.
+void synth_render_frame(const ltc_synth_t *s, const SMPTETimecode *tc, int *level,
+                        void *out, int nsamples) {
+    LTCFrame frame;
+    synth_build_frame(s, tc, &frame);
+    const uint8_t *bytes = (const uint8_t*)&frame;
+    uint8_t *dst = (uint8_t*)out;
+    size_t sample_bytes = (size_t)s->format->bytes;
+    int lv = *level;
+
+    if (s->byte_len > 0 && nsamples == s->byte_len * SYNTH_BYTES_PER_FRAME) {
+        size_t len = (size_t)s->byte_len * sample_bytes;
+        for (int i = 0; i < SYNTH_BYTES_PER_FRAME; i++) {
+            memcpy(dst, s->byte_tmpl + ((size_t)bytes[i] * 2 + lv) * len, len);
+            lv = s->byte_next_level[bytes[i]][lv];
+            dst += len;
+        }
+    } else {
+        // Spread the frame over 80 cells whose lengths differ by at most one sample
+        int pos = 0;
+        for (int k = 0; k < SYNTH_BITS_PER_FRAME; k++) {
+            int bit = (bytes[k >> 3] >> (k & 7)) & 1;
+            int end = (int)(((int64_t)(k + 1) * nsamples) / SYNTH_BITS_PER_FRAME);
+            int len = end - pos;
+            int li = len - s->cell_len;
+            if (li == 0 || li == 1) {
+                memcpy(dst + pos * sample_bytes, bit_template(s, li, bit, lv), len * sample_bytes);
+            } else {
+                store_cell(s, dst + pos * sample_bytes, len, bit, lv);
+            }
+            lv = bit ? lv : !lv;
+            pos = end;
+        }
+    }
+
+    *level = lv;
+}
@@ -0,0 +1,45 @@
+#ifndef LTC_SYNTH_H
+#define LTC_SYNTH_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+#include "ltc_format.h"
+
+#define SYNTH_BITS_PER_FRAME 80
+#define SYNTH_BYTES_PER_FRAME (SYNTH_BITS_PER_FRAME / 8)
+#define SYNTH_RISE_TIME_US 25          // SMPTE 12M edge rise time (25us +/- 5us)
+#define SYNTH_DEFAULT_AMPLITUDE 23197  // -3 dBFS at 16 bits, same nominal level as libltc
+#define SYNTH_MAX_CELL 256             // Longest bit cell in samples (192 kHz at 23.976 fps is 101)
+
+// Encoder selection (encoder config option)
+#define ENCODER_BUILTIN 0   // Table-driven synthesizer (default)
+#define ENCODER_LIBLTC  1   // libltc encoder, kept for validation
+
+// Precomputed biphase-mark waveform templates for one frame rate / sample rate,
+// stored in the output sample format so rendering is a plain copy.
+// Templates are immutable after synth_init, so one synthesizer can be shared
+// between threads as long as each caller keeps its own output level.
+typedef struct {
+    int std;                  // LTC_TV_* standard used for parity/flag placement
+    int drop_frame;
+    const sample_format_t *format;
+    int32_t amplitude;        // At the format's full scale
+    int ramp;                 // Samples per transition edge
+    int cell_len;             // Shortest bit cell in samples (nominal frame / 80)
+    int byte_len;             // Samples per byte template, 0 if frames are not a multiple of 80
+    uint8_t *bit_tmpl;        // [len 0..1][bit][level][cell_len + 1] samples
+    uint8_t *byte_tmpl;       // [byte][level][byte_len] samples
+    uint8_t byte_next_level[256][2];
+} ltc_synth_t;
+
+extern int encoder_mode;
+
+// amplitude is given at 16-bit scale and scaled to the format's
+int synth_init(ltc_synth_t *s, unsigned int sample_rate, int frame_samples,
+               const framerate_spec_t *rate, const sample_format_t *format, int16_t amplitude);
+void synth_free(ltc_synth_t *s);
+void synth_build_frame(const ltc_synth_t *s, const SMPTETimecode *tc, LTCFrame *frame);
+void synth_render_frame(const ltc_synth_t *s, const SMPTETimecode *tc, int *level,
+                        void *out, int nsamples);
+
+#endif // LTC_SYNTH_H
@@ -1,5 +1,10 @@
 #include "ltc_common.h"
 #include "ltc_ntp.h"
+#include "ltc_tod.h"
+#include "ltc_correction.h"
+#include "ltc_latency.h"
+#include "ltc_output.h"
+#include "ltc_pipeline.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -8,7 +13,6 @@
 #include <sched.h>
 #include <inttypes.h>
 #include <errno.h>
-#include <math.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -16,29 +20,53 @@
 
 // Global variables
 volatile sig_atomic_t running = 1;
+int alsa_access_mode = ALSA_ACCESS_AUTO;
+int frames_per_period = 1;
+int timecode_mode = TIMECODE_WALLCLOCK;
+int resync_interval_frames = 250;   // Compare against the wall clock every 250 frames
+int resync_threshold_frames = 2;    // Jam when the counter is more than 2 frames off
 
 // Supported rates definition
 const framerate_spec_t supported_rates[] = {
-    {24.0,    LTC_TV_525_60, 0, "24"},
-    {25.0,    LTC_TV_625_50, 0, "25"},
-    {29.97,   LTC_TV_525_60, 0, "29.97"},
-    {30.0,    LTC_TV_525_60, 0, "30"},
-    {29.97,   LTC_TV_525_60, 1, "29.97df"},
-    {30.0,    LTC_TV_525_60, 1, "30df"}
+    {24000, 1001, 1, LTC_TV_525_60, 0, "23.976"},
+    {24,    1,    1, LTC_TV_525_60, 0, "24"},
+    {25,    1,    1, LTC_TV_625_50, 0, "25"},
+    {30000, 1001, 1, LTC_TV_525_60, 0, "29.97"},
+    {30,    1,    1, LTC_TV_525_60, 0, "30"},
+    {30000, 1001, 1, LTC_TV_525_60, 1, "29.97df"},
+    {30,    1,    1, LTC_TV_525_60, 1, "30df"},
+    {48000, 1001, 2, LTC_TV_525_60, 0, "47.95"},
+    {48,    1,    2, LTC_TV_525_60, 0, "48"},
+    {50,    1,    2, LTC_TV_625_50, 0, "50"},
+    {60000, 1001, 2, LTC_TV_525_60, 0, "59.94"},
+    {60,    1,    2, LTC_TV_525_60, 0, "60"}
 };
 
 const int NUM_SUPPORTED_RATES = sizeof(supported_rates)/sizeof(supported_rates[0]);
 
-void format_timecode(char *buf, size_t n, const SMPTETimecode *tc, double fps, int drop_frame) {
-    if (drop_frame) {
+void format_timecode(char *buf, size_t n, const SMPTETimecode *tc, const rate_plan_t *plan) {
+    if (plan->spec->drop_frame) {
         snprintf(buf, n, "\r%02d:%02d:%02d;%02d @ %.3f fps",
-            tc->hours, tc->mins, tc->secs, tc->frame, fps);
+            tc->hours, tc->mins, tc->secs, tc->frame, framerate_fps(plan->spec));
     } else {
         snprintf(buf, n, "\r%02d:%02d:%02d:%02d @ %.3f fps",
-            tc->hours, tc->mins, tc->secs, tc->frame, fps);
+            tc->hours, tc->mins, tc->secs, tc->frame, framerate_fps(plan->spec));
     }
 }
 
+// Frame number within the second for a sub-second offset in microseconds.
+// Frame 0 starts exactly at the second boundary.
+static inline int frame_in_second(const rate_plan_t *plan, int64_t frac_us, int mins) {
+    int frame = (int)(((uint64_t)frac_us * plan->frame_mult) >> RATE_FRAME_SHIFT);
+    if (plan->spec->drop_frame) {
+        int d = 2; // always 2 frames dropped per minute
+        if ((mins % 10) != 0 && frame < d) {
+            frame = d;
+        }
+    }
+    return frame;
+}
+
 // Pin process to CPU core (core_id is 0-based)
 void pin_to_core(int core_id) {
     if (core_id < 0) return;  // Allow disabling CPU pinning via config
@@ -52,159 +80,108 @@ void pin_to_core(int core_id) {
     }
 }
 
-// Fill SMPTETimecode from adjusted system clock (with ALSA buffer delay compensation)
-// Using 64-bit fixed-point arithmetic with microsecond precision
-void get_timecode_with_alsa_latency(SMPTETimecode *tc, double fps, snd_pcm_t *pcm, int drop_frame) {
+// Allow the calling thread on every CPU except core_id, so housekeeping work
+// stays off the core reserved for audio
+void unpin_from_core(int core_id) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long i = 0; i < cpus && i < CPU_SETSIZE; i++) {
+        if (i != core_id) CPU_SET(i, &cpuset);
+    }
+    if (CPU_COUNT(&cpuset) == 0) return; // Single core: nowhere else to go
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {
+        fprintf(stderr, "Warning: Failed to move thread off CPU core %d: %s\n",
+                core_id, strerror(errno));
+    }
+}
+
+// For helper threads created by the real-time thread: drop the inherited
+// SCHED_FIFO policy and leave the audio core
+void drop_realtime(int core_id) {
+    struct sched_param sp;
+    sp.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+    unpin_from_core(core_id);
+}
+
+// NTP-corrected system time, in microseconds, at which the next sample written
+// to the output will be heard. *tv_nsec receives the sub-second part of the raw
+// clock reading, which indexes the adaptive correction table.
+int64_t get_output_time_us(frame_clock_t *clock, const rate_plan_t *plan, output_t *out, long *tv_nsec) {
+    // Query the output latency together with the system time it was measured
+    // at. With driver timestamps a preemption here no longer skews the result.
     struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t buffer_delay_us = 0;
+    output_measure(out, &ts, &buffer_delay_us);
 
     // Convert to microseconds (64-bit integer)
     int64_t time_us = (int64_t)ts.tv_sec * MICROSECONDS_PER_SECOND + 
                       (int64_t)(ts.tv_nsec / NANOSECONDS_PER_MICROSECOND);
     
-    // Apply NTP offset if enabled
+    // Apply NTP offset if enabled. The correction is read lock-free into the
+    // caller's snapshot so the sync thread can never hold this thread up
+    // mid-frame; it is a curve in monotonic time, so it moves on smoothly
+    // between syncs rather than per frame rendered.
     if (use_ntp) {
-        pthread_mutex_lock(&ntp_lock);
-        
-        // Apply current offset
-        time_us += ntp_offset_us;
-        
-        // Adjust the offset gradually toward target with each frame
-        if (ntp_offset_us != ntp_target_offset_us && ntp_adjustment_step_us != 0) {
-            ntp_offset_us += ntp_adjustment_step_us;
-            
-            // Check if we've reached or overshot the target
-            if ((ntp_adjustment_step_us > 0 && ntp_offset_us >= ntp_target_offset_us) || 
-                (ntp_adjustment_step_us < 0 && ntp_offset_us <= ntp_target_offset_us)) {
-                ntp_offset_us = ntp_target_offset_us;  // We've reached the target
-                ntp_adjustment_step_us = 0;            // Stop adjusting
-            }
-        }
-        
-        pthread_mutex_unlock(&ntp_lock);
+        time_us += ntp_correction_now(&clock->correction);
     }
 
-    // Query accurate output latency information
-    snd_pcm_sframes_t delay_frames = 0;
-    snd_pcm_status_t *status;
-    snd_pcm_status_alloca(&status);
-    
-    // Get detailed PCM status
-    if (snd_pcm_status(pcm, status) >= 0) {
-        // Get delay in frames - this includes both hardware and software buffers
-        delay_frames = snd_pcm_status_get_delay(status);
-        
-        // Ensure delay is non-negative
-        if (delay_frames < 0) {
-            delay_frames = 0;
-        }
-    } else {
-        // Fallback to simpler delay function if status call fails
-        if (snd_pcm_delay(pcm, &delay_frames) < 0) {
-            delay_frames = 0;
-        }
-        if (delay_frames < 0) {
-            delay_frames = 0;
-        }
-    }
-    
-    // Convert delay to microseconds with high precision
-    // Use 64-bit arithmetic throughout to avoid overflows and maximize precision
-    int64_t buffer_delay_us = (delay_frames * MICROSECONDS_PER_SECOND + (SAMPLE_RATE / 2)) / SAMPLE_RATE;
-    
-    // Calculate frame duration in microseconds
-    int64_t frame_us = 0;
-    if (fps == 29.97) {
-        frame_us = MICROSECONDS_PER_SECOND * 1001 / 30000; // Exact for NTSC
-    } else if (fps == 23.976) {
-        frame_us = MICROSECONDS_PER_SECOND * 1001 / 24000; // Exact for 23.976
-    } else {
-        frame_us = (int64_t)(MICROSECONDS_PER_SECOND / fps);
-    }
-    
-    // Calculate frame fraction within the current second (0.0 to 1.0)
-    double second_fraction = (double)(ts.tv_nsec) / 1000000000.0;
-    
-    // Adaptive timing correction - more at start of second, less at end
-    // This helps address the phenomenon where start of second has more delay
-    // At the start of a second (second_fraction near 0), apply max correction
-    // At the end of a second (second_fraction near 1), apply min correction
-    int64_t min_frames_offset = 1.0;  // Minimum frames offset (near end of second)
-    int64_t max_frames_offset = 3.5;  // Maximum frames offset (near start of second) - increased to compensate for 3-frame delay
-    
-    // Use a non-linear curve for better adaptation - exponential decay curve
-    // This provides more correction at the beginning of the second and
-    // approaches the minimum correction more quickly toward the end
-    double decay_rate = 3.0;  // Higher value for faster transition to lower correction
-    double normalized_position = 1.0 - exp(-decay_rate * second_fraction);
-    double offset_frames = max_frames_offset - (normalized_position * (max_frames_offset - min_frames_offset));
-    
-    // Add a small phase adjustment term to fine-tune the timing
-    // Sine wave with period of 1 second adds a gentle oscillation that can help with alignment
-    double phase_adjustment = 0.2 * sin(2 * M_PI * second_fraction);
-    offset_frames += phase_adjustment;
-    
-    // Add a slight quadratic component to further enhance start-of-second correction
-    offset_frames += 0.3 * (1.0 - second_fraction * second_fraction);
-    
-    // Calculate processing offset in microseconds
-    int64_t processing_offset_us = (int64_t)(frame_us * offset_frames);
-    
-    // Adjust time by buffer latency plus processing offset (microseconds)
-    int64_t adj_time_us = time_us + buffer_delay_us + processing_offset_us;
-    
-    // Convert back to seconds and fraction for localtime
-    time_t adj_whole = (time_t)(adj_time_us / MICROSECONDS_PER_SECOND);
+    *tv_nsec = ts.tv_nsec;
+    return time_us + buffer_delay_us;
+}
+
+// Split a system time in microseconds into timecode, using the day anchor in
+// the caller's clock state
+void timecode_at(frame_clock_t *clock, SMPTETimecode *tc, const rate_plan_t *plan, int64_t adj_time_us) {
+    // Split into local time of day using the cached day anchor, which avoids
+    // localtime() (and its /etc/localtime stat and global lock) on this thread
     int64_t adj_frac_us = adj_time_us % MICROSECONDS_PER_SECOND;
-    
-    struct tm *tm = localtime(&adj_whole);
-
-    tc->years   = tm->tm_year + 1900;
-    tc->months  = tm->tm_mon + 1;
-    tc->days    = tm->tm_mday;
-    tc->hours   = tm->tm_hour;
-    tc->mins    = tm->tm_min;
-    tc->secs    = tm->tm_sec;
-
-    // Calculate frame using precise frame boundaries to ensure frame 0 aligns with second rollover
-    // First convert fps to a rational number for fixed-point math
-    int64_t frame_numerator, frame_denominator;
-    
-    if (fps == 29.97) {
-        // Use exact fraction for NTSC rates (30000/1001)
-        frame_numerator = 30000;
-        frame_denominator = 1001;
-    } else if (fps == 23.976) {
-        frame_numerator = 24000;
-        frame_denominator = 1001;
-    } else {
-        // For integer rates, use simple conversion
-        frame_numerator = (int64_t)(fps * 1000);
-        frame_denominator = 1000;
+    tod_split(&clock->anchor, adj_time_us / MICROSECONDS_PER_SECOND, tc);
+
+    // Frame within the second from the precomputed reciprocal of the frame duration
+    tc->frame = frame_in_second(plan, adj_frac_us, tc->mins);
+}
+
+// First frame boundary at or after time_us. Frames restart at every whole
+// second, as frame_in_second() counts them, so *frame receives the index of
+// the frame starting there within its second.
+int64_t frame_boundary_after(const rate_plan_t *plan, int64_t time_us, int *frame) {
+    int64_t sec_us = time_us - time_us % MICROSECONDS_PER_SECOND;
+    int64_t frac_us = time_us - sec_us;
+    int64_t scale = plan->ltc_den * MICROSECONDS_PER_SECOND;
+
+    // Boundaries rounded up so they map back to their own frame
+    int64_t index = frac_us * plan->ltc_num / scale;
+    int64_t start = (index * scale + plan->ltc_num - 1) / plan->ltc_num;
+    if (start < frac_us) {
+        index++;
+        start = (index * scale + plan->ltc_num - 1) / plan->ltc_num;
     }
-    
-    // Calculate microseconds per frame (exactly)
-    int64_t us_per_frame = (MICROSECONDS_PER_SECOND * frame_denominator) / frame_numerator;
-    
-    // Calculate frame number by determining how many complete frames fit in the fractional part
-    int frame = (int)(adj_frac_us / us_per_frame);
-    
-    // Ensure perfect alignment - frame 0 must start exactly at second boundary
-    // Adjust for any rounding errors
-    if (frame >= (int)(frame_numerator / frame_denominator))
-        frame = (int)(frame_numerator / frame_denominator) - 1;
-    
-    if (drop_frame) {
-        int d = 2; // always 2 frames dropped per minute
-        if ((tc->mins % 10) != 0 && frame < d) {
-            frame = d;
-        }
+    if (start >= MICROSECONDS_PER_SECOND) {
+        index = 0;
+        start = MICROSECONDS_PER_SECOND;
     }
-    tc->frame = frame;
+    *frame = (int)index;
+    return sec_us + start;
+}
+
+// Fill SMPTETimecode from adjusted system clock (with output buffer delay compensation)
+// Using 64-bit fixed-point arithmetic with microsecond precision
+void get_timecode_with_latency(frame_clock_t *clock, SMPTETimecode *tc, const rate_plan_t *plan, output_t *out) {
+    long tv_nsec = 0;
+    int64_t time_us = get_output_time_us(clock, plan, out, &tv_nsec);
+
+    // Adaptive timing correction - more at start of second, less at end.
+    // The curve is evaluated once per rate into correction_table, so this
+    // is a single lookup on the second fraction instead of exp/sin per frame.
+    int64_t processing_offset_us = correction_lookup(&correction_table, tv_nsec);
+
+    timecode_at(clock, tc, plan, time_us + processing_offset_us);
 }
 
 // Get the current timecode without buffer compensation for display
-void get_display_timecode(SMPTETimecode *tc, double fps, int drop_frame, int64_t ntp_offset) {
+void get_display_timecode(SMPTETimecode *tc, const rate_plan_t *plan, int64_t ntp_offset) {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
     
@@ -215,46 +192,105 @@ void get_display_timecode(SMPTETimecode *tc, double fps, int drop_frame, int64_t
     // Apply NTP offset if needed, but don't add the buffer delay
     time_us += ntp_offset;
     
-    // Convert back to seconds and fraction for localtime
-    time_t adj_whole = (time_t)(time_us / MICROSECONDS_PER_SECOND);
+    // Split into local time of day using the display thread's own day anchor
+    static tod_anchor_t anchor;
     int64_t adj_frac_us = time_us % MICROSECONDS_PER_SECOND;
+    tod_split(&anchor, time_us / MICROSECONDS_PER_SECOND, tc);
     
-    struct tm *tm = localtime(&adj_whole);
-    
-    tc->years   = tm->tm_year + 1900;
-    tc->months  = tm->tm_mon + 1;
-    tc->days    = tm->tm_mday;
-    tc->hours   = tm->tm_hour;
-    tc->mins    = tm->tm_min;
-    tc->secs    = tm->tm_sec;
-    
-    // Calculate frame using precise frame boundaries
-    int64_t frame_numerator, frame_denominator;
-    
-    if (fps == 29.97) {
-        frame_numerator = 30000;
-        frame_denominator = 1001;
-    } else if (fps == 23.976) {
-        frame_numerator = 24000;
-        frame_denominator = 1001;
-    } else {
-        frame_numerator = (int64_t)(fps * 1000);
-        frame_denominator = 1000;
+    tc->frame = frame_in_second(plan, adj_frac_us, tc->mins);
+}
+
+// Advance a timecode by exactly one frame, skipping the dropped frame
+// numbers at the start of each minute (except every tenth) in drop-frame mode
+void timecode_increment(SMPTETimecode *tc, const rate_plan_t *plan) {
+    if (++tc->frame < plan->frames_per_second) {
+        return;
     }
-    
-    int64_t us_per_frame = (MICROSECONDS_PER_SECOND * frame_denominator) / frame_numerator;
-    int frame = (int)(adj_frac_us / us_per_frame);
-    
-    if (frame >= (int)(frame_numerator / frame_denominator))
-        frame = (int)(frame_numerator / frame_denominator) - 1;
-    
-    if (drop_frame) {
-        int d = 2; // always 2 frames dropped per minute
-        if ((tc->mins % 10) != 0 && frame < d) {
-            frame = d;
+    tc->frame = 0;
+    if (++tc->secs == 60) {
+        tc->secs = 0;
+        if (++tc->mins == 60) {
+            tc->mins = 0;
+            if (++tc->hours == 24) {
+                tc->hours = 0;
+            }
+        }
+        if (plan->spec->drop_frame && (tc->mins % 10) != 0) {
+            tc->frame = 2;
         }
     }
-    tc->frame = frame;
+}
+
+// Frames since midnight for a timecode, accounting for drop-frame numbering
+int64_t timecode_to_frames(const SMPTETimecode *tc, const rate_plan_t *plan) {
+    int64_t total_mins = (int64_t)tc->hours * 60 + tc->mins;
+    int64_t frames = ((total_mins * 60) + tc->secs) * plan->frames_per_second + tc->frame;
+    if (plan->spec->drop_frame) {
+        frames -= 2 * (total_mins - total_mins / 10);
+    }
+    return frames;
+}
+
+// Timecode for a frame count since midnight (inverse of timecode_to_frames).
+// Only the time fields are set.
+void timecode_from_frames(SMPTETimecode *tc, const rate_plan_t *plan, int64_t frames) {
+    int64_t fps = plan->frames_per_second;
+    frames %= plan->frames_per_day;
+    if (frames < 0) frames += plan->frames_per_day;
+    if (plan->spec->drop_frame) {
+        // Put back the two frame numbers skipped in every minute but the tenth
+        int64_t per_min = fps * 60 - 2;
+        int64_t per_ten_mins = fps * 600 - 18;
+        int64_t rem = frames % per_ten_mins;
+        frames += 18 * (frames / per_ten_mins) + 2 * ((rem - 2) / per_min);
+    }
+    tc->frame = (unsigned char)(frames % fps);
+    tc->secs = (unsigned char)((frames / fps) % 60);
+    tc->mins = (unsigned char)((frames / (fps * 60)) % 60);
+    tc->hours = (unsigned char)(frames / (fps * 3600));
+}
+
+// Advance the timecode by one frame per call and only compare it against the
+// latency-compensated wall clock every resync_interval_frames frames. The
+// counter is jammed to the wall clock when it is more than
+// resync_threshold_frames off, so output stays strictly monotonic otherwise.
+void get_timecode_incremental(tc_counter_t *counter, frame_clock_t *clock, SMPTETimecode *tc, const rate_plan_t *plan, output_t *out) {
+    if (!counter->valid) {
+        get_timecode_with_latency(clock, &counter->tc, plan, out);
+        counter->valid = 1;
+        counter->frames_until_check = resync_interval_frames;
+        *tc = counter->tc;
+        return;
+    }
+
+    timecode_increment(&counter->tc, plan);
+    // Check straight away at midnight so the date fields roll over
+    int midnight = counter->tc.hours == 0 && counter->tc.mins == 0 &&
+                   counter->tc.secs == 0 && counter->tc.frame == 0;
+
+    if (--counter->frames_until_check <= 0 || midnight) {
+        counter->frames_until_check = resync_interval_frames;
+
+        SMPTETimecode ref;
+        get_timecode_with_latency(clock, &ref, plan, out);
+
+        // Frame error, wrapped into +/- half a day so midnight does not count as drift
+        int64_t frames_per_day = plan->frames_per_day;
+        int64_t err = timecode_to_frames(&counter->tc, plan) - timecode_to_frames(&ref, plan);
+        if (err > frames_per_day / 2) err -= frames_per_day;
+        if (err < -frames_per_day / 2) err += frames_per_day;
+
+        if (llabs(err) > resync_threshold_frames) {
+            counter->tc = ref;
+            counter->jams++;
+        } else {
+            counter->tc.years = ref.years;
+            counter->tc.months = ref.months;
+            counter->tc.days = ref.days;
+        }
+    }
+
+    *tc = counter->tc;
 }
 
 // Find framerate_spec_t from arg, or NULL if not found
@@ -266,6 +302,110 @@ const framerate_spec_t* parse_rate(const char* arg) {
     return NULL;
 }
 
+static int64_t gcd64(int64_t a, int64_t b) {
+    while (b != 0) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Video frame rate as a floating point value, for display only
+double framerate_fps(const framerate_spec_t *rate) {
+    return (double)rate->fps_num / rate->fps_den;
+}
+
+// Precompute the per-frame constants for a rate at the given sample rate
+void rate_plan_init(rate_plan_t *plan, const framerate_spec_t *rate, unsigned int sample_rate) {
+    memset(plan, 0, sizeof(*plan));
+    plan->spec = rate;
+    plan->sample_rate = sample_rate;
+
+    // LTC words go out at fps / ltc_divisor
+    plan->ltc_num = rate->fps_num;
+    plan->ltc_den = (int64_t)rate->fps_den * rate->ltc_divisor;
+    int64_t g = gcd64(plan->ltc_num, plan->ltc_den);
+    plan->ltc_num /= g;
+    plan->ltc_den /= g;
+
+    plan->frames_per_second = (int)((plan->ltc_num + plan->ltc_den - 1) / plan->ltc_den);
+    plan->us_per_frame = MICROSECONDS_PER_SECOND * plan->ltc_den / plan->ltc_num;
+
+    // Reciprocal rounded up, so (frac_us * frame_mult) >> RATE_FRAME_SHIFT equals
+    // floor(frac_us * num / (den * 10^6)) for any frac_us < 10^6. The shift is
+    // split in two halves to stay within 64 bits on 32-bit targets.
+    const int half_shift = RATE_FRAME_SHIFT / 2;
+    uint64_t divisor = (uint64_t)plan->ltc_den * MICROSECONDS_PER_SECOND;
+    uint64_t scaled = (uint64_t)plan->ltc_num << half_shift;
+    plan->frame_mult = ((scaled / divisor) << half_shift) +
+                       (((scaled % divisor) << half_shift) / divisor) + 1;
+
+    SMPTETimecode day = { .hours = 24 };
+    plan->frames_per_day = timecode_to_frames(&day, plan);
+
+    cadence_init(&plan->cadence, plan);
+}
+
+// Set up the frame length cadence for a rate plan
+void cadence_init(frame_cadence_t *c, const rate_plan_t *plan) {
+    // Samples per frame = sample_rate / ltc_rate = sample_rate * ltc_den / ltc_num
+    c->num = (int64_t)plan->sample_rate * plan->ltc_den;
+    c->den = plan->ltc_num;
+    int64_t g = gcd64(c->num, c->den);
+    c->num /= g;
+    c->den /= g;
+    c->acc = 0;
+    c->base = (int)(c->num / c->den);
+}
+
+// Length of the next frame in samples. The remainder is carried in an error
+// accumulator, so 29.97 fps at 48 kHz yields 1601, 1602, 1601, 1602, 1602, ...
+int cadence_next(frame_cadence_t *c) {
+    int64_t total = c->acc + c->num;
+    c->acc = total % c->den;
+    return (int)(total / c->den);
+}
+
+// Sample position at which a frame starts, counting from frame 0
+int64_t cadence_position(const frame_cadence_t *c, int64_t frame) {
+    return frame * c->num / c->den;
+}
+
+// Put the cadence where it would be after `frame` calls to cadence_next,
+// so independent chunks of a stream produce the same frame lengths
+void cadence_seek(frame_cadence_t *c, int64_t frame) {
+    c->acc = (frame % c->den) * (c->num % c->den) % c->den;
+}
+
+// Longest frame the cadence can produce
+int cadence_max(const frame_cadence_t *c) {
+    return c->base + (c->num % c->den != 0 ? 1 : 0);
+}
+
+// Print the current timecode if it changed since the last call. display->tc
+// holds the timecode last shown.
+void timecode_display_update(timecode_display_state_t *display) {
+    char buf[80];
+    SMPTETimecode tc;
+
+    // Get the offset the audio thread is currently applying
+    int64_t current_ntp_offset = 0;
+    if (use_ntp) {
+        current_ntp_offset = ntp_applied_offset();
+    }
+
+    get_display_timecode(&tc, display->plan, current_ntp_offset);
+
+    // Only update the display if the timecode changed
+    if (memcmp(&tc, &display->tc, sizeof(SMPTETimecode)) != 0) {
+        format_timecode(buf, sizeof(buf), &tc, display->plan);
+        fwrite(buf, 1, strlen(buf), stdout);
+        fflush(stdout);
+        display->tc = tc;
+    }
+}
+
 // Low-priority thread to display timecode on the console
 void* timecode_display_thread(void *arg) {
     timecode_display_state_t *display = (timecode_display_state_t*)arg;
@@ -276,29 +416,8 @@ void* timecode_display_thread(void *arg) {
     pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
 #endif
 
-    char buf[80];
-    SMPTETimecode tc, last_tc = {0};
-    
     while (display->running) {
-        // Get current NTP offset (safe to read without mutex as it's atomic)
-        int64_t current_ntp_offset = 0;
-        if (use_ntp) {
-            pthread_mutex_lock(&ntp_lock);
-            current_ntp_offset = ntp_offset_us;
-            pthread_mutex_unlock(&ntp_lock);
-        }
-        
-        // Generate the display timecode in the display thread
-        get_display_timecode(&tc, display->fps, display->drop_frame, current_ntp_offset);
-        
-        // Only update the display if the timecode changed
-        if (memcmp(&tc, &last_tc, sizeof(SMPTETimecode)) != 0) {
-            format_timecode(buf, sizeof(buf), &tc, display->fps, display->drop_frame);
-            fwrite(buf, 1, strlen(buf), stdout);
-            fflush(stdout);
-            last_tc = tc;
-        }
-        
+        timecode_display_update(display);
         usleep(5000); // 5ms is plenty responsive for console display
     }
     printf("\n");
@@ -337,7 +456,8 @@ int is_console_interactive(void) {
 }
 
 // Configure ALSA PCM for minimal latency while maintaining stability
-int configure_alsa_for_low_latency(snd_pcm_t *pcm, unsigned int rate, int ltc_frame_size) {
+int configure_alsa_for_low_latency(snd_pcm_t *pcm, snd_pcm_format_t format, unsigned int rate,
+                                   int ltc_frame_size, snd_pcm_uframes_t avail_min, int *use_mmap) {
     int err;
     snd_pcm_hw_params_t *hw_params;
     snd_pcm_sw_params_t *sw_params;
@@ -352,26 +472,48 @@ int configure_alsa_for_low_latency(snd_pcm_t *pcm, unsigned int rate, int ltc_fr
         return err;
     }
     
-    // Set access type
-    if ((err = snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
-        fprintf(stderr, "Cannot set access type: %s\n", snd_strerror(err));
-        return err;
+    // Set access type - prefer mmap so LTC samples are rendered straight into the
+    // DMA ring buffer, and fall back to read/write access if the device refuses it
+    *use_mmap = 0;
+    if (alsa_access_mode != ALSA_ACCESS_RW &&
+        snd_pcm_hw_params_test_access(pcm, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0 &&
+        snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0) {
+        *use_mmap = 1;
+    } else {
+        if (alsa_access_mode == ALSA_ACCESS_MMAP) {
+            fprintf(stderr, "Warning: mmap access not supported by device, falling back to read/write\n");
+        }
+        if ((err = snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+            fprintf(stderr, "Cannot set access type: %s\n", snd_strerror(err));
+            return err;
+        }
     }
     
     // Set sample format
-    if ((err = snd_pcm_hw_params_set_format(pcm, hw_params, SND_PCM_FORMAT_S16_LE)) < 0) {
-        fprintf(stderr, "Cannot set sample format: %s\n", snd_strerror(err));
+    if ((err = snd_pcm_hw_params_set_format(pcm, hw_params, format)) < 0) {
+        fprintf(stderr, "Cannot set sample format %s: %s\n", snd_pcm_format_name(format), snd_strerror(err));
         return err;
     }
     
-    // Set sample rate
+    // Keep ALSA's resampler out of the path whenever the device runs at this
+    // rate itself
+    int resample_off = snd_pcm_hw_params_set_rate_resample(pcm, hw_params, 0) == 0 &&
+                       snd_pcm_hw_params_test_rate(pcm, hw_params, rate, 0) == 0;
+    if (!resample_off) {
+        snd_pcm_hw_params_set_rate_resample(pcm, hw_params, 1);
+    }
+    
+    // Set sample rate. Frame lengths and timing were derived from it, so the
+    // device has to run at exactly this rate.
     unsigned int exact_rate = rate;
     if ((err = snd_pcm_hw_params_set_rate_near(pcm, hw_params, &exact_rate, 0)) < 0) {
         fprintf(stderr, "Cannot set sample rate: %s\n", snd_strerror(err));
         return err;
     }
     if (exact_rate != rate) {
-        fprintf(stderr, "Warning: Sample rate adjusted from %u to %u Hz\n", rate, exact_rate);
+        fprintf(stderr, "Device cannot run at %u Hz (nearest %u Hz), set sample-rate to a supported rate\n",
+                rate, exact_rate);
+        return -EINVAL;
     }
     
     // Set number of channels
@@ -380,16 +522,19 @@ int configure_alsa_for_low_latency(snd_pcm_t *pcm, unsigned int rate, int ltc_fr
         return err;
     }
     
-    // Calculate buffer size based on LTC frame size
+    // Calculate buffer size based on LTC frame size (the longest frame of the cadence;
+    // fractional rates alternate between two lengths one sample apart)
     // Aim for reasonable buffer that can hold multiple frames but still has low latency
-    snd_pcm_uframes_t buffer_size = ltc_frame_size * 4; // 4 frames worth of buffer
+    snd_pcm_uframes_t buffer_size = ltc_frame_size * BUFFER_FRAMES(frames_per_period);
     if ((err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw_params, &buffer_size)) < 0) {
         fprintf(stderr, "Cannot set buffer size: %s\n", snd_strerror(err));
         return err;
     }
     
-    // Set period size to match LTC frame size for accurate timing
-    snd_pcm_uframes_t period_size = ltc_frame_size;
+    // Set period size to match LTC frame size for accurate timing, or a batch
+    // of frames to wake less often. Writes do not need to be period aligned,
+    // so variable-length frames are fine
+    snd_pcm_uframes_t period_size = ltc_frame_size * frames_per_period;
     int dir = 0;
     if ((err = snd_pcm_hw_params_set_period_size_near(pcm, hw_params, &period_size, &dir)) < 0) {
         fprintf(stderr, "Cannot set period size: %s\n", snd_strerror(err));
@@ -414,12 +559,16 @@ int configure_alsa_for_low_latency(snd_pcm_t *pcm, unsigned int rate, int ltc_fr
         return err;
     }
     
-    // Allow transfer when at least one sample can be processed
-    if ((err = snd_pcm_sw_params_set_avail_min(pcm, sw_params, 1)) < 0) {
+    // Allow transfer when at least one sample can be processed. The event loop
+    // asks for a whole period instead, so poll wakes it once per write.
+    if ((err = snd_pcm_sw_params_set_avail_min(pcm, sw_params, avail_min)) < 0) {
         fprintf(stderr, "Cannot set minimum available frames: %s\n", snd_strerror(err));
         return err;
     }
     
+    // Timestamp status reports so the delay can be tied to the instant it was measured
+    int latency_source = latency_configure(pcm, hw_params, sw_params);
+    
     // Commit software parameters
     if ((err = snd_pcm_sw_params(pcm, sw_params)) < 0) {
         fprintf(stderr, "Cannot set software parameters: %s\n", snd_strerror(err));
@@ -439,14 +588,109 @@ int configure_alsa_for_low_latency(snd_pcm_t *pcm, unsigned int rate, int ltc_fr
     snd_pcm_hw_params_get_buffer_size(hw_params, &actual_buffer_size);
     snd_pcm_hw_params_get_period_size(hw_params, &actual_period_size, &dir);
     
-    fprintf(stderr, "ALSA buffer configuration: period_size=%lu, buffer_size=%lu (%.2f ms latency)\n",
+    fprintf(stderr, "ALSA buffer configuration: period_size=%lu, buffer_size=%lu (%.2f ms latency), access=%s, latency source=%s\n",
             actual_period_size, actual_buffer_size, 
-            (float)actual_buffer_size * 1000.0f / (float)rate);
-            
-    // Try to disable ALSA's internal resampling if possible
-    if ((err = snd_pcm_hw_params_set_rate_resample(pcm, hw_params, 0)) == 0) {
+            (float)actual_buffer_size * 1000.0f / (float)rate,
+            *use_mmap ? "mmap" : "rw", latency_source_name(latency_source));
+    if (resample_off) {
         fprintf(stderr, "Disabled ALSA resampling for lower latency\n");
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+// Wait until the ring has room for `frames` samples and map them for writing.
+// Returns 1 with *dst pointing into the DMA buffer, 0 if the free region wraps
+// around the end of the ring (caller should render into its own buffer and use
+// alsa_mmap_write instead), or a negative ALSA error code.
+int alsa_mmap_begin_frame(snd_pcm_t *pcm, snd_pcm_uframes_t frames, void **dst, snd_pcm_uframes_t *offset) {
+    const snd_pcm_channel_area_t *areas;
+    int err;
+
+    for (;;) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            return (int)avail;
+        }
+        if ((snd_pcm_uframes_t)avail >= frames) {
+            break;
+        }
+        // Not enough room yet - block until the hardware frees up a period
+        if ((err = snd_pcm_wait(pcm, 1000)) < 0) {
+            return err;
+        }
+        if (err == 0) {
+            return -EIO; // Timed out, device has stopped consuming samples
+        }
+    }
+
+    snd_pcm_uframes_t contiguous = frames;
+    if ((err = snd_pcm_mmap_begin(pcm, &areas, offset, &contiguous)) < 0) {
+        return err;
+    }
+    if (contiguous < frames) {
+        // Release the partial region untouched, the bounce path will handle the wrap
+        snd_pcm_mmap_commit(pcm, *offset, 0);
+        return 0;
+    }
+
+    *dst = (char*)areas[0].addr + (areas[0].first + *offset * areas[0].step) / 8;
+    return 1;
+}
+
+// Hand a region obtained from alsa_mmap_begin_frame back to the hardware.
+// Starts the stream once the first frame is queued, matching the start
+// threshold used for read/write access.
+int alsa_mmap_commit_frame(snd_pcm_t *pcm, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames) {
+    snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, frames);
+    if (committed < 0) {
+        return (int)committed;
+    }
+    if ((snd_pcm_uframes_t)committed != frames) {
+        return -EPIPE;
+    }
+    if (snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED) {
+        int err = snd_pcm_start(pcm);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return (int)committed;
+}
+
+// Copy a rendered frame into the mmap ring, splitting it where the ring wraps
+int alsa_mmap_write(snd_pcm_t *pcm, const void *buf, snd_pcm_uframes_t frames) {
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t done = 0;
+    int err;
+
+    while (done < frames) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            return (int)avail;
+        }
+        if (avail == 0) {
+            if ((err = snd_pcm_wait(pcm, 1000)) < 0) {
+                return err;
+            }
+            if (err == 0) {
+                return -EIO;
+            }
+            continue;
+        }
+
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t chunk = frames - done;
+        if ((err = snd_pcm_mmap_begin(pcm, &areas, &offset, &chunk)) < 0) {
+            return err;
+        }
+        char *dst = (char*)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+        memcpy(dst, (const char*)buf + snd_pcm_frames_to_bytes(pcm, done),
+               snd_pcm_frames_to_bytes(pcm, chunk));
+        if ((err = alsa_mmap_commit_frame(pcm, offset, chunk)) < 0) {
+            return err;
+        }
+        done += chunk;
+    }
+    return (int)done;
+}
@@ -9,15 +9,16 @@
  * - Real-time priority for audio thread
  * - Audio interface can be selected with -d or --device option
  * - Console timecode output is only shown when run directly (not as a systemd service or with --quiet)
- * - NTP synchronization with multiple-query best-offset selection
+ * - NTP synchronization with RFC 5905 clock filtering and multi-server selection
+ * - Table-driven LTC waveform synthesis (libltc encoder selectable for validation)
  *
  * Compile:
- *   gcc -pthread -o ltc_timecode_pi ltc_timecode_pi.c ltc_timecode.c ltc_ntp.c ltc_config.c -lltc -lasound -lm
+ *   make    (sources and flags are listed in the Makefile; needs libltc and libasound)
  *
  * Usage:
  *   ./ltc_timecode_pi [-q] [-d device] [frame_rate]
  *   -q or --quiet: suppress console timecode output (recommended for daemon/service use)
- *   frame_rate: 24, 25, 29.97, 30, 29.97df, 30df (default: 25)
+ *   frame_rate: 23.976, 24, 25, 29.97, 29.97df, 30, 30df, 47.95, 48, 50, 59.94, 60 (default: 25)
  *   -d or --device: ALSA device string (default: "default")
  *
  * To list available ALSA PCM devices, run:
@@ -41,18 +42,112 @@
 #include "ltc_common.h"
 #include "ltc_ntp.h"
 #include "ltc_config.h"
+#include "ltc_synth.h"
+#include "ltc_convert.h"
+#include "ltc_bench.h"
+#include "ltc_tod.h"
+#include "ltc_correction.h"
+#include "ltc_latency.h"
+#include "ltc_pll.h"
+#include "ltc_calibrate.h"
+#include "ltc_render.h"
+#include "ltc_output.h"
+#include "ltc_pipeline.h"
+#include "ltc_reactor.h"
+#include "ltc_xrun.h"
+#include "ltc_usage.h"
+#include "ltc_format.h"
+#include "ltc_state.h"
 
 // Global variables required by header files
 int use_ntp = 0;
-int64_t ntp_offset_us = 0;
 int64_t ntp_target_offset_us = 0;
-pthread_mutex_t ntp_lock = PTHREAD_MUTEX_INITIALIZER;
 double selected_fps = 25.0;  // Default frame rate, will be updated when actual rate is known
 
 void handle_signal(int signo) {
     running = 0;
 }
 
+// Audio path state shared by the blocking loop and the event loop
+typedef struct {
+    output_t *output;
+    frame_source_t *source;
+    pipeline_t *pipeline;          // NULL renders each frame inline
+    void *frame;                   // Room for one write
+    int batch_frames;              // Frames per write (frames-per-period)
+    int batch_samples;             // Longest write
+    frame_batch_t batch;
+    xrun_state_t xrun;
+} audio_loop_t;
+
+// Recover from a failed output call. Returns as audio_write_frame does.
+static int audio_recover(audio_loop_t *a, int err) {
+    if (!running) return 1; // allow clean exit
+    xrun_detected(&a->xrun);
+    if (output_recover(a->output, err) < 0) return -1;
+    if (a->pipeline) pipeline_reset(a->pipeline);
+    return 0;
+}
+
+// Produce and commit one frame, or a batch of frames-per-period frames with
+// a single write. Returns 0 to continue, 1 once stopping and -1 if the
+// output could not be recovered.
+static int audio_write_frame(void *arg) {
+    audio_loop_t *a = (audio_loop_t*)arg;
+    SMPTETimecode tc;
+    const void *ready = NULL;
+    int frame_samples;
+
+    // After an xrun, pad with silence to the next frame boundary and take the
+    // timecode afresh from there, so the first frame out starts on time
+    if (a->xrun.pending) {
+        int frame_index;
+        int silence = xrun_resume(&a->xrun, a->output, a->source->plan, a->frame, &frame_index);
+        if (silence < 0) {
+            return audio_recover(a, silence);
+        }
+        if (a->pipeline) {
+            pipeline_resync(a->pipeline, silence, frame_index);
+        } else {
+            frame_source_resync(a->source, frame_index);
+        }
+    }
+
+    if (a->pipeline) {
+        if (pipeline_next(a->pipeline, &ready, &frame_samples) < 0) return 1;
+    } else if (a->batch_frames == 1) {
+        frame_samples = frame_source_prepare(a->source, a->output, &tc);
+    } else {
+        // Frame lengths are only known once each frame is timed
+        frame_samples = a->batch_samples;
+    }
+
+    // With ALSA mmap access, convert straight into the DMA ring when the frame
+    // fits contiguously; otherwise render into the local frame buffer
+    void *out = a->frame;
+    int err = output_begin(a->output, frame_samples, &out);
+    if (err < 0) {
+        return audio_recover(a, err);
+    }
+
+    if (ready) {
+        memcpy(out, ready, (size_t)frame_samples * a->output->format->bytes);
+    } else if (a->batch_frames == 1) {
+        frame_source_render(a->source, &tc, out, frame_samples);
+    } else {
+        frame_samples = frame_batch_render(&a->batch, a->source, out, a->batch_frames);
+    }
+
+    int written = output_commit(a->output, out, frame_samples);
+    if (written < 0) {
+        return audio_recover(a, written);
+    }
+    if (a->pipeline) {
+        pipeline_done(a->pipeline, written);
+    }
+    return 0;
+}
+
 // Lock memory to prevent paging which can cause latency spikes
 static void lock_memory(void) {
     if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
@@ -65,8 +160,20 @@ static void lock_memory(void) {
 int main(int argc, char *argv[]) {
     // Default values
     const char *pcm_device = DEFAULT_PCM_DEVICE;
-    const framerate_spec_t* rate = &supported_rates[1]; // Default: 25
+    const framerate_spec_t* rate = parse_rate("25"); // Default: 25
     int quiet = 0;
+    int cli_alsa_access = -1;
+    int cli_encoder = -1;
+    int cli_timecode_mode = -1;
+    int cli_resync_interval = -1;
+    int cli_resync_threshold = -1;
+    int cli_latency_source = -1;
+    int cli_lookahead = -1;
+    int cli_event_loop = -1;
+    int cli_frames_per_period = -1;
+    int cli_sample_format = -1;
+    int cli_sample_rate = -1;
+    const char *calibrate_device = NULL;
     char config_file[PATH_MAX] = DEFAULT_CONFIG_FILE;
 
     // Option parsing
@@ -79,6 +186,24 @@ int main(int argc, char *argv[]) {
         {"ntp-server", required_argument, 0, 0 },
         {"ntp-sync-interval", required_argument, 0, 0 },
         {"ntp-slew-period", required_argument, 0, 0 },
+        {"alsa-access", required_argument, 0, 0 },
+        {"encoder", required_argument, 0, 0 },
+        {"benchmark", no_argument, 0, 0 },
+        {"timecode-mode", required_argument, 0, 0 },
+        {"resync-interval", required_argument, 0, 0 },
+        {"resync-threshold", required_argument, 0, 0 },
+        {"latency-source", required_argument, 0, 0 },
+        {"calibrate", required_argument, 0, 0 },
+        {"lookahead-frames", required_argument, 0, 0 },
+        {"event-loop", required_argument, 0, 0 },
+        {"frames-per-period", required_argument, 0, 0 },
+        {"sample-format", required_argument, 0, 0 },
+        {"sample-rate", required_argument, 0, 0 },
+        {"render", required_argument, 0, 0 },
+        {"render-start", required_argument, 0, 0 },
+        {"render-duration", required_argument, 0, 0 },
+        {"render-format", required_argument, 0, 0 },
+        {"render-threads", required_argument, 0, 0 },
         {0, 0, 0, 0}
     };
     while ((opt = getopt_long(argc, argv, "qd:", long_options, &opt_index)) != -1) {
@@ -102,6 +227,95 @@ int main(int argc, char *argv[]) {
                     fprintf(stderr, "Warning: Invalid NTP slew period, using default (30 seconds)\n");
                     ntp_slew_period = 30;
                 }
+            } else if (strcmp(long_options[opt_index].name, "alsa-access") == 0) {
+                cli_alsa_access = parse_alsa_access(optarg);
+                if (cli_alsa_access < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(long_options[opt_index].name, "benchmark") == 0) {
+                return run_benchmarks();
+            } else if (strcmp(long_options[opt_index].name, "timecode-mode") == 0) {
+                cli_timecode_mode = parse_timecode_mode(optarg);
+                if (cli_timecode_mode < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(long_options[opt_index].name, "resync-interval") == 0) {
+                cli_resync_interval = atoi(optarg);
+                if (cli_resync_interval < 1) {
+                    fprintf(stderr, "Warning: Invalid resync interval, using default (250 frames)\n");
+                    cli_resync_interval = 250;
+                }
+            } else if (strcmp(long_options[opt_index].name, "resync-threshold") == 0) {
+                cli_resync_threshold = atoi(optarg);
+                if (cli_resync_threshold < 0) {
+                    fprintf(stderr, "Warning: Invalid resync threshold, using default (2 frames)\n");
+                    cli_resync_threshold = 2;
+                }
+            } else if (strcmp(long_options[opt_index].name, "latency-source") == 0) {
+                cli_latency_source = parse_latency_source(optarg);
+                if (cli_latency_source < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(long_options[opt_index].name, "lookahead-frames") == 0) {
+                cli_lookahead = atoi(optarg);
+                if (cli_lookahead < 0 || cli_lookahead > PIPELINE_MAX_LOOKAHEAD) {
+                    fprintf(stderr, "Warning: Invalid lookahead, using default (%d frames)\n", PIPELINE_DEFAULT_LOOKAHEAD);
+                    cli_lookahead = PIPELINE_DEFAULT_LOOKAHEAD;
+                }
+            } else if (strcmp(long_options[opt_index].name, "event-loop") == 0) {
+                cli_event_loop = parse_event_loop(optarg);
+                if (cli_event_loop < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(long_options[opt_index].name, "frames-per-period") == 0) {
+                cli_frames_per_period = atoi(optarg);
+                if (cli_frames_per_period < 1 || cli_frames_per_period > MAX_FRAMES_PER_PERIOD) {
+                    fprintf(stderr, "Warning: Invalid frames per period, using default (1 frame)\n");
+                    cli_frames_per_period = 1;
+                }
+            } else if (strcmp(long_options[opt_index].name, "sample-format") == 0) {
+                cli_sample_format = parse_sample_format(optarg);
+                if (cli_sample_format < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(long_options[opt_index].name, "sample-rate") == 0) {
+                unsigned int hz;
+                if (parse_sample_rate(optarg, &hz) < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                cli_sample_rate = (int)hz;
+            } else if (strcmp(long_options[opt_index].name, "calibrate") == 0) {
+                calibrate_device = optarg;
+            } else if (strcmp(long_options[opt_index].name, "render") == 0) {
+                render_options.path = optarg;
+            } else if (strcmp(long_options[opt_index].name, "render-start") == 0) {
+                render_options.start = optarg;
+            } else if (strcmp(long_options[opt_index].name, "render-duration") == 0) {
+                render_options.duration_s = atof(optarg);
+            } else if (strcmp(long_options[opt_index].name, "render-format") == 0) {
+                render_options.format = parse_render_format(optarg);
+                if (render_options.format < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(long_options[opt_index].name, "render-threads") == 0) {
+                render_options.threads = atoi(optarg);
+                if (render_options.threads < 1 || render_options.threads > RENDER_MAX_THREADS) {
+                    fprintf(stderr, "Warning: Invalid render threads, using default (one per CPU)\n");
+                    render_options.threads = 0;
+                }
+            } else if (strcmp(long_options[opt_index].name, "encoder") == 0) {
+                cli_encoder = parse_encoder_mode(optarg);
+                if (cli_encoder < 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
             }
         } else switch (opt) {
             case 'd':
@@ -119,6 +333,49 @@ int main(int argc, char *argv[]) {
     // Parse config file (if present)
     parse_config(config_file);
     // Use config values if not overridden by command line
+    if (cli_alsa_access >= 0) {
+        alsa_access_mode = cli_alsa_access;
+    }
+    if (cli_encoder >= 0) {
+        encoder_mode = cli_encoder;
+    }
+    if (cli_timecode_mode >= 0) {
+        timecode_mode = cli_timecode_mode;
+    }
+    if (cli_resync_interval >= 0) {
+        resync_interval_frames = cli_resync_interval;
+    }
+    if (cli_resync_threshold >= 0) {
+        resync_threshold_frames = cli_resync_threshold;
+    }
+    if (cli_latency_source >= 0) {
+        latency_source_mode = cli_latency_source;
+    }
+    if (cli_lookahead >= 0) {
+        lookahead_frames = cli_lookahead;
+    }
+    if (cli_event_loop >= 0) {
+        event_loop_mode = cli_event_loop;
+    }
+    if (cli_frames_per_period >= 0) {
+        frames_per_period = cli_frames_per_period;
+    }
+    if (cli_sample_format >= 0) {
+        sample_format_mode = cli_sample_format;
+    }
+    if (cli_sample_rate >= 0) {
+        sample_rate_setting = (unsigned int)cli_sample_rate;
+    }
+    if (calibrate_device) {
+        // Calibration measures the uncorrected wall clock path, frame by frame
+        timecode_mode = TIMECODE_WALLCLOCK;
+        lookahead_frames = 0;
+    }
+    if (event_loop_mode == EVENT_LOOP_SINGLE) {
+        // Everything stays on the one real-time thread: a producer would be
+        // a second thread on its core, and waiting for it would stall the loop
+        lookahead_frames = 0;
+    }
     if (strcmp(pcm_device, DEFAULT_PCM_DEVICE) == 0 && strlen(config_device) > 0) {
         pcm_device = config_device;
     }
@@ -133,8 +390,49 @@ int main(int argc, char *argv[]) {
         if (cfg_rate) rate = cfg_rate;
     }
     
-    // Update the global selected_fps variable with the actual frame rate
-    selected_fps = rate->fps;
+    rate_plan_t plan;
+    if (render_options.path) {
+        // Offline render: no audio device, no real-time setup
+        rate_plan_init(&plan, rate, sample_rate_setting ? sample_rate_setting : DEFAULT_SAMPLE_RATE);
+        return run_render(&render_options, &plan);
+    }
+
+    // Output setup: an ALSA PCM, or a null/file/pipe sink on a simulated clock.
+    // Opened before anything is printed, as pipe:- takes over stdout
+    output_t output;
+    if (output_open(&output, pcm_device) < 0) {
+        return 1;
+    }
+
+    // What the last run learned: clock frequency and offset, and the output's
+    // negotiated format and rate
+    saved_state_t saved;
+    int have_state = state_load(&saved) == 0;
+
+    // Run at the device's own format and rate where possible, so ALSA's plug
+    // layer has nothing left to convert. Left on auto, the same card gets
+    // the configuration it was given last time without probing again.
+    int format_choice = sample_format_mode;
+    unsigned int rate_choice = sample_rate_setting;
+    if (have_state && saved.sample_format >= 0 &&
+        sample_format_mode == SAMPLE_FORMAT_AUTO && sample_rate_setting == 0) {
+        char card[128];
+        output_card_name(&output, card, sizeof(card));
+        if (strcmp(card, saved.card) == 0) {
+            format_choice = saved.sample_format;
+            rate_choice = saved.sample_rate;
+        }
+    }
+    if (output_negotiate(&output, format_choice, rate_choice) < 0) {
+        return 1;
+    }
+
+    // Precompute the per-frame rate constants for the output sample rate
+    rate_plan_init(&plan, rate, output.rate);
+    correction_build(&correction_table, &correction_curve, &plan);
+
+    // Update the global selected_fps variable with the actual LTC frame rate
+    selected_fps = (double)plan.ltc_num / plan.ltc_den;
 
     // If not explicitly quiet and running interactively, show timecode display
     int show_timecode_display = !quiet && is_console_interactive();
@@ -144,7 +442,14 @@ int main(int argc, char *argv[]) {
         printf("ltc_timecode_pi starting (quiet mode)\n");
         printf("PCM device: %s\n", pcm_device);
         printf("Frame rate: %s fps (%.3f), Drop Frame: %s\n",
-            rate->name, rate->fps, rate->drop_frame ? "YES" : "NO");
+            rate->name, framerate_fps(rate), rate->drop_frame ? "YES" : "NO");
+        if (timecode_mode == TIMECODE_INCREMENTAL) {
+            printf("Timecode mode: incremental (check every %d frames, jam above %d frames)\n",
+                resync_interval_frames, resync_threshold_frames);
+        } else if (timecode_mode == TIMECODE_PLL) {
+            printf("Timecode mode: audio clock PLL (time constant %.1f s, jam above %d frames)\n",
+                pll_time_constant, resync_threshold_frames);
+        }
         fflush(stdout);
     }
 
@@ -155,6 +460,11 @@ int main(int argc, char *argv[]) {
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
+    if (event_loop_mode != EVENT_LOOP_THREADS) {
+        // The event loop reads them from a signalfd instead; blocked before
+        // any thread starts so none of them takes the signal
+        event_loop_block_signals();
+    }
 
     // Default to core 3, but allow overriding via config
     int cpu_core = 3;
@@ -171,140 +481,303 @@ int main(int argc, char *argv[]) {
     // Lock memory to prevent paging which can cause latency spikes
     lock_memory();
 
-    // ALSA setup
-    snd_pcm_t *pcm;
-    if (snd_pcm_open(&pcm, pcm_device, SND_PCM_STREAM_PLAYBACK, 0) < 0) {
-        fprintf(stderr, "Failed to open PCM device '%s'\n", pcm_device);
-        return 1;
+    // Frame lengths for the output FPS. Fractional rates (29.97, 23.976) alternate
+    // between two lengths so the audio clock advances at exactly the rational rate
+    frame_cadence_t cadence = plan.cadence;
+    int ltc_frame_size = cadence_max(&cadence);
+    if (timecode_mode == TIMECODE_PLL) {
+        ltc_frame_size += 1; // The PLL may lengthen a frame by one sample
     }
 
-    // Calculate frame size for output FPS
-    int ltc_frame_size = (int)round((double)SAMPLE_RATE / rate->fps);
+    // One write per period: a frame, or a batch of frames-per-period frames
+    int period_samples = ltc_frame_size * frames_per_period;
+
+    // The event loop is woken once there is room for a whole period
+    if (event_loop_mode != EVENT_LOOP_THREADS) {
+        output.wake_samples = period_samples;
+    }
 
     // Use our optimized ALSA configuration for low latency
-    if (configure_alsa_for_low_latency(pcm, SAMPLE_RATE, ltc_frame_size) < 0) {
-        fprintf(stderr, "Failed to configure ALSA for low latency\n");
+    if (output_configure(&output, output.rate, ltc_frame_size) < 0) {
+        fprintf(stderr, "Failed to configure %s output for low latency\n", output.ops->name);
         return 1;
     }
+    state_note_output(&output);
 
-    LTCEncoder *encoder = ltc_encoder_create((double)SAMPLE_RATE, rate->fps, rate->std, rate->drop_frame);
-    if (!encoder) {
-        fprintf(stderr, "Failed to create LTC encoder\n");
+    // A measured profile for this card and these rates replaces the configured
+    // correction curve
+    if (calibrate_device) {
+        if (calibration_start(calibrate_device, &plan) < 0) {
+            return 1;
+        }
+    } else {
+        calibration_load(&output, &plan, &correction_table);
+    }
+
+    // The built-in synthesizer renders straight from precomputed templates;
+    // the libltc encoder is kept available to validate its output against
+    ltc_synth_t synth;
+    LTCEncoder *encoder = NULL;
+    if (encoder_mode == ENCODER_LIBLTC) {
+        encoder = ltc_encoder_create((double)output.rate, selected_fps, rate->std, rate->drop_frame);
+        if (!encoder) {
+            fprintf(stderr, "Failed to create LTC encoder\n");
+            return 1;
+        }
+    } else if (synth_init(&synth, output.rate, cadence.base, rate, output.format, SYNTH_DEFAULT_AMPLITUDE) < 0) {
+        fprintf(stderr, "Failed to create LTC synthesizer\n");
         return 1;
     }
 
-    int16_t *frame = (int16_t*)malloc(sizeof(int16_t) * ltc_frame_size);
+    void    *frame = malloc((size_t)period_samples * output.format->bytes);
     int8_t  *ltc_buf = (int8_t*)malloc(sizeof(int8_t) * ltc_frame_size);
-    const int16_t max_amp = INT16_MAX;
+    int16_t *s16_buf = (int16_t*)malloc(sizeof(int16_t) * ltc_frame_size);
+    const convert_kernel_t *convert = convert_select();
+
+    // Timecode selection and encoding for each frame
+    frame_source_t source;
+    memset(&source, 0, sizeof(source));
+    source.plan = &plan;
+    source.cadence = cadence;
+    source.mode = timecode_mode;
+    source.calibrate = calibrate_device != NULL;
+    source.synth = &synth;
+    source.encoder = encoder;
+    source.ltc_buf = ltc_buf;
+    source.convert = convert;
+    source.format = output.format;
+    source.s16_buf = s16_buf;
+    pll_init(&source.pll, &plan);
 
     // Timecode display thread state
     timecode_display_state_t display;
     pthread_mutex_init(&display.lock, NULL);
     memset(&display.tc, 0, sizeof(SMPTETimecode));
-    display.fps = rate->fps;
-    display.drop_frame = rate->drop_frame;
+    display.plan = &plan;
     display.running = 1;
 
     // Start display thread if interactive
     pthread_t disp_thread;
-    if (show_timecode_display) {
-        // Pass PCM handle to display thread so it can display accurate timecode
-        display.pcm = pcm;
+    if (show_timecode_display && event_loop_mode == EVENT_LOOP_THREADS) {
+        // Pass the output to display thread so it can display accurate timecode
+        display.output = &output;
         pthread_create(&disp_thread, NULL, timecode_display_thread, &display);
     }
 
+    // Lookahead slots hold one write each; keep at least two so rendering
+    // overlaps the write
+    int lookahead_slots = (lookahead_frames + frames_per_period - 1) / frames_per_period;
+    if (lookahead_slots < 2) lookahead_slots = 2;
+
     if (show_timecode_display) {
         printf("ALSA-paced LTC generator running on CPU core 3 with buffer latency compensation.\n");
         printf("PCM device: %s\n", pcm_device);
         printf("Frame rate: %s fps (%.3f), Drop Frame: %s\n",
-            rate->name, rate->fps, rate->drop_frame ? "YES" : "NO");
+            rate->name, framerate_fps(rate), rate->drop_frame ? "YES" : "NO");
+        if (rate->ltc_divisor > 1) {
+            printf("LTC carried as frame pairs at %.3f fps\n", selected_fps);
+        }
+        if (encoder) {
+            printf("Encoder: libltc, %s sample conversion\n", convert->name);
+        }
+        if (output.ops->simulated) {
+            printf("Output: %s (simulated clock)\n", output.ops->name);
+        } else {
+            printf("Latency source: %s\n", latency_source_name(latency_active_source()));
+        }
+        if (frames_per_period > 1) {
+            printf("Batching: %d frames per period, one write per %.1f ms\n",
+                   frames_per_period, frames_per_period * plan.us_per_frame / 1000.0);
+        }
+        if (lookahead_frames > 0) {
+            printf("Lookahead: %d frames rendered ahead of the audio thread\n",
+                   lookahead_slots * frames_per_period);
+        }
+        if (event_loop_mode == EVENT_LOOP_SINGLE) {
+            printf("Event loop: audio, display, NTP and signals on one thread\n");
+        } else if (event_loop_mode == EVENT_LOOP_SPLIT) {
+            printf("Event loop: audio and signals on the real-time thread, display and NTP on a housekeeping thread\n");
+        }
         printf("Ctrl+C to stop.\n");
     }
 
+    // Rebuild cached day anchors if the timezone changes while running: on
+    // the housekeeping loop in the event-loop modes, else on a thread
+    int tz_fd = -1;
+    if (event_loop_mode == EVENT_LOOP_THREADS) {
+        tod_start_tz_watch(cpu_core);
+    } else {
+        tz_fd = tod_tz_watch_open();
+    }
+
     // Set real-time priority for audio (main) thread
     set_realtime_priority();
     
-    // Start NTP synchronization thread if a server is specified
+    // Start NTP synchronization if servers are specified
     pthread_t ntp_thread;
+    ntp_client_t ntp_client;
+    int ntp_open = 0;
     if (use_ntp && strlen(ntp_server) > 0) {
         if (show_timecode_display) {
-            printf("Using NTP server: %s for timecode synchronization\n", ntp_server);
+            printf("Using NTP servers: %s for timecode synchronization\n", ntp_server);
+        }
+        if (ntp_client_open(&ntp_client, ntp_server, show_timecode_display, cpu_core) == 0) {
+            ntp_open = 1;
+        } else {
+            fprintf(stderr, "NTP sync disabled\n");
         }
-        // Initial NTP sync
-        if (query_ntp_server(ntp_server) == 0) {
+    }
+    if (ntp_open) {
+        // Warm start. The frequency holds across reboots; the offset only
+        // within the boot it was measured in, when output can start on it
+        // at once and the initial burst refines it in the background.
+        int warm = 0;
+        if (have_state && saved.has_clock) {
+            warm = state_same_boot(&saved);
+            int64_t offset_us = warm ? state_offset_now(&saved) : 0;
+            ntp_client_restore(&ntp_client, saved.freq_ppb, offset_us);
+            fprintf(stderr, "Restored NTP frequency %+.3f ppm%s from %s\n",
+                    saved.freq_ppb / 1000.0, warm ? " and offset" : "", state_file);
+        }
+        if (warm) {
+            ntp_client_start(&ntp_client);
+        } else if (ntp_client_sync(&ntp_client) == 0) {
             if (show_timecode_display) {
-                printf("Initial NTP sync successful with server %s, target offset: %" PRId64 " microseconds\n", 
-                       ntp_server, ntp_target_offset_us);
+                printf("Initial");
+                ntp_report_sync(&ntp_client);
             }
         } else {
-            fprintf(stderr, "Initial NTP sync failed with server %s\n", ntp_server);
-        }
-        
-        // Set up arguments for NTP sync thread
-        ntp_thread_args_t *ntp_args = malloc(sizeof(ntp_thread_args_t));
-        if (ntp_args == NULL) {
-            fprintf(stderr, "Failed to allocate memory for NTP thread arguments\n");
-            return 1;
+            fprintf(stderr, "Initial NTP sync failed\n");
         }
-        ntp_args->server = ntp_server;
-        ntp_args->display_enabled = show_timecode_display;
         
-        // Start thread for periodic NTP sync
-        pthread_create(&ntp_thread, NULL, ntp_sync_thread, ntp_args);
-    }
-
-    // Main loop: output LTC to ALSA, update display state
-    while (running) {
-        SMPTETimecode tc;
-        get_timecode_with_alsa_latency(&tc, rate->fps, pcm, rate->drop_frame);
-        ltc_encoder_set_timecode(encoder, &tc);
-        ltc_encoder_encode_frame(encoder);
-
-        // Suppress deprecated warning for ltc_encoder_get_buffer
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-        ltc_encoder_get_buffer(encoder, (ltcsnd_sample_t*)ltc_buf);
-        #pragma GCC diagnostic pop
-
-        for (int i = 0; i < ltc_frame_size; ++i) {
-            float s = ltc_buf[i] / 127.0f;
-            if (s > 1.0f) s = 1.0f;
-            if (s < -1.0f) s = -1.0f;
-            frame[i] = (int16_t)(s * max_amp);
+        // Start thread for periodic NTP sync; the event loop runs the client itself
+        if (event_loop_mode == EVENT_LOOP_THREADS) {
+            pthread_create(&ntp_thread, NULL, ntp_sync_thread, &ntp_client);
         }
+    }
 
-        int written = snd_pcm_writei(pcm, frame, ltc_frame_size);
-        if (written < 0) {
-            if (!running) break; // allow clean exit
-            snd_pcm_recover(pcm, written, 1);
-            snd_pcm_prepare(pcm);
-            continue;
-        }
+    // Pre-render frames on a producer thread so the audio thread only commits.
+    // The producer drops the real-time priority and core it inherits.
+    pipeline_t pipeline;
+    if (lookahead_frames > 0 &&
+        pipeline_start(&pipeline, &source, &output, lookahead_slots, ltc_frame_size, frames_per_period, cpu_core) < 0) {
+        return 1;
+    }
+
+    audio_loop_t audio;
+    memset(&audio, 0, sizeof(audio));
+    audio.output = &output;
+    audio.source = &source;
+    audio.pipeline = lookahead_frames > 0 ? &pipeline : NULL;
+    audio.frame = frame;
+    audio.batch_frames = frames_per_period;
+    audio.batch_samples = period_samples;
+    frame_batch_init(&audio.batch, &output);
+
+    // Wakeups and CPU time of the audio thread, to weigh frames-per-period
+    usage_sample_t usage_start, usage_end;
+    usage_sample(&usage_start);
 
-        // Display updates are now handled by the display thread
+    int exit_status = 0;
+    event_loop_t loop;
+    memset(&loop, 0, sizeof(loop));
+    if (event_loop_mode != EVENT_LOOP_THREADS) {
+        // One epoll loop: woken by the output, the display timer, the NTP
+        // socket and signals, with no other periodic wakeups
+        loop.mode = event_loop_mode;
+        loop.output = &output;
+        loop.frame_size = period_samples;
+        loop.write_frame = audio_write_frame;
+        loop.ctx = &audio;
+        loop.display = show_timecode_display ? &display : NULL;
+        loop.ntp = ntp_open ? &ntp_client : NULL;
+        loop.tz_fd = tz_fd;
+        loop.cpu_core = cpu_core;
+        exit_status = event_loop_run(&loop);
+        running = 0;
+    } else {
+        // Main loop: output LTC, blocking in the output when its buffer is full.
+        // Display updates are handled by the display thread.
+        while (running) {
+            int status = audio_write_frame(&audio);
+            if (status < 0) {
+                exit_status = 1;
+                break;
+            } else if (status > 0) {
+                break;
+            }
+        }
+    }
+    usage_sample(&usage_end);
+    if (lookahead_frames > 0) {
+        pipeline_stop(&pipeline);
     }
 
     // Cleanup
     display.running = 0;
-    if (show_timecode_display) {
+    if (show_timecode_display && event_loop_mode == EVENT_LOOP_THREADS) {
         pthread_join(disp_thread, NULL);
     }
     
+    tod_stop_tz_watch();
+    tod_tz_watch_close(tz_fd);
+
+    if (calibrate_device && calibration_finish(&output) < 0) {
+        exit_status = 1;
+    }
+
     // Wait for NTP thread if it was started
-    if (use_ntp && strlen(ntp_server) > 0) {
+    if (ntp_open && event_loop_mode == EVENT_LOOP_THREADS) {
         pthread_join(ntp_thread, NULL);
     }
+    if (ntp_open) {
+        state_note_clock(&ntp_client.discipline);
+        if (show_timecode_display) {
+            ntp_report_stats(&ntp_client);
+        }
+        ntp_client_close(&ntp_client);
+    }
+    state_save();
     
-    ltc_encoder_free(encoder);
+    if (encoder) {
+        ltc_encoder_free(encoder);
+    } else {
+        synth_free(&synth);
+    }
     free(frame);
     free(ltc_buf);
-    snd_pcm_drain(pcm);
-    snd_pcm_close(pcm);
+    free(s16_buf);
+    output_close(&output);
     pthread_mutex_destroy(&display.lock);
-    pthread_mutex_destroy(&ntp_lock);
     
     if (show_timecode_display) {
+        if (timecode_mode == TIMECODE_INCREMENTAL) {
+            printf("Frame counter re-anchored to wall clock %lu times\n", source.counter.jams);
+        } else if (timecode_mode == TIMECODE_PLL) {
+            printf("Audio clock %+.2f ppm, %lu one-sample frame adjustments, %lu re-anchors\n",
+                   pll_audio_ppm(&source.pll, &plan), source.pll.adjustments, source.pll.jams);
+        }
+        if (lookahead_frames > 0) {
+            printf("Lookahead: %lu frames re-rendered, audio thread waited %lu times\n",
+                   pipeline.rerenders, pipeline.waits);
+        }
+        usage_report_t usage;
+        usage_compare(&usage_start, &usage_end, &usage);
+        printf("Audio thread: %d frame%s per write, %.1f wakeups/s, %.2f%% CPU (process %.2f%%)\n",
+               frames_per_period, frames_per_period == 1 ? "" : "s",
+               usage.thread_wakeups_per_s, usage.thread_cpu_pct, usage.process_cpu_pct);
+        if (audio.xrun.count > 0) {
+            printf("Output xruns: %lu, recovered to a frame boundary in %.1f ms on average (%.1f ms worst)\n",
+                   audio.xrun.count, audio.xrun.total_us / 1000.0 / audio.xrun.count, audio.xrun.max_us / 1000.0);
+        }
+        if (event_loop_mode != EVENT_LOOP_THREADS && loop.seconds > 0.0) {
+            printf("Event loop: %.1f wakeups/s on the real-time thread", loop.audio_wakeups / loop.seconds);
+            if (event_loop_mode == EVENT_LOOP_SPLIT) {
+                printf(", %.1f/s housekeeping", loop.housekeeping_wakeups / loop.seconds);
+            }
+            printf("\n");
+        }
         printf("Exited gracefully.\n");
     }
-    return 0;
+    return exit_status;
 }
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "ltc_tod.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+// Bumped by the watch whenever the timezone definition changes
+static atomic_uint tz_generation = 0;
+
+static int tz_file_wd = -1;
+static pthread_t tz_thread;
+static int tz_thread_started = 0;
+static int tz_thread_fd = -1;
+static int tz_stop_fd = -1;
+static int tz_cpu_core;
+
+static long utc_offset_at(int64_t time_s) {
+    time_t t = (time_t)time_s;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    return tm.tm_gmtoff;
+}
+
+// Recompute the anchor around time_s. This is the only place that calls
+// into the C library's timezone code, normally once per day.
+static void tod_rebuild(tod_anchor_t *anchor, int64_t time_s) {
+    time_t t = (time_t)time_s;
+    struct tm tm;
+    localtime_r(&t, &tm);
+
+    int64_t sod = (int64_t)tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+    anchor->day_start_s = time_s - sod;
+    anchor->valid_from_s = time_s;
+    anchor->years = tm.tm_year + 1900;
+    anchor->months = tm.tm_mon + 1;
+    anchor->days = tm.tm_mday;
+    anchor->tz_generation = atomic_load_explicit(&tz_generation, memory_order_acquire);
+
+    // Valid until the next local midnight, unless the UTC offset changes first
+    int64_t until = anchor->day_start_s + TOD_SECONDS_PER_DAY;
+    if (sod >= TOD_SECONDS_PER_DAY) {
+        until = time_s + 1; // Leap second, just rebuild on the next call
+    }
+    long offset = tm.tm_gmtoff;
+    if (utc_offset_at(until - 1) != offset) {
+        // Binary search for the first second with the new offset
+        int64_t lo = time_s, hi = until - 1;
+        while (hi - lo > 1) {
+            int64_t mid = lo + (hi - lo) / 2;
+            if (utc_offset_at(mid) == offset) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        until = hi;
+    }
+    anchor->valid_until_s = until;
+}
+
+void tod_split(tod_anchor_t *anchor, int64_t time_s, SMPTETimecode *tc) {
+    if (time_s < anchor->valid_from_s || time_s >= anchor->valid_until_s ||
+        anchor->tz_generation != atomic_load_explicit(&tz_generation, memory_order_relaxed)) {
+        tod_rebuild(anchor, time_s);
+    }
+
+    int sod = (int)(time_s - anchor->day_start_s);
+    tc->years   = anchor->years;
+    tc->months  = anchor->months;
+    tc->days    = anchor->days;
+    tc->hours   = sod / 3600;
+    tc->mins    = (sod / 60) % 60;
+    tc->secs    = sod % 60;
+}
+
+// Watch the zone file itself (following the symlink) for in-place updates
+static int tz_watch_file(int fd) {
+    return inotify_add_watch(fd, TOD_TZ_FILE, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+}
+
+int tod_tz_watch_open(void) {
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "Warning: Failed to watch timezone changes: %s\n", strerror(errno));
+        return -1;
+    }
+    // Also watch /etc, since tools such as timedatectl replace the
+    // /etc/localtime symlink rather than modify the file it points to
+    tz_file_wd = tz_watch_file(fd);
+    inotify_add_watch(fd, "/etc", IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_CLOSE_WRITE);
+    return fd;
+}
+
+void tod_tz_watch_read(int fd) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len <= 0) {
+        return;
+    }
+
+    int changed = 0;
+    for (char *p = buf; p < buf + len; ) {
+        struct inotify_event *ev = (struct inotify_event*)p;
+        if (ev->wd == tz_file_wd ||
+            (ev->len > 0 && (strcmp(ev->name, "localtime") == 0 || strcmp(ev->name, "timezone") == 0))) {
+            changed = 1;
+        }
+        p += sizeof(struct inotify_event) + ev->len;
+    }
+
+    if (changed) {
+        // Re-read the zone and re-arm the file watch, which may now point elsewhere
+        if (tz_file_wd >= 0) {
+            inotify_rm_watch(fd, tz_file_wd);
+        }
+        tz_file_wd = tz_watch_file(fd);
+        tzset();
+        atomic_fetch_add_explicit(&tz_generation, 1, memory_order_release);
+        fprintf(stderr, "Timezone definition changed, rebuilding day anchors\n");
+    }
+}
+
+void tod_tz_watch_close(int fd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+    tz_file_wd = -1;
+}
+
+// Sleeps until the zone changes or tod_stop_tz_watch, with no periodic wakeup
+static void* tz_watch_thread(void *arg) {
+    (void)arg;
+
+#ifdef SCHED_IDLE
+    struct sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    // Started after main pinned itself to the audio core
+    unpin_from_core(tz_cpu_core);
+
+    struct pollfd pfd[2] = {
+        { .fd = tz_thread_fd, .events = POLLIN },
+        { .fd = tz_stop_fd, .events = POLLIN },
+    };
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfd[1].revents) {
+            break;
+        }
+        if (pfd[0].revents) {
+            tod_tz_watch_read(tz_thread_fd);
+        }
+    }
+    return NULL;
+}
+
+int tod_start_tz_watch(int cpu_core) {
+    tz_cpu_core = cpu_core;
+    tz_stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (tz_stop_fd < 0) {
+        fprintf(stderr, "Warning: Failed to watch timezone changes: %s\n", strerror(errno));
+        return -1;
+    }
+    tz_thread_fd = tod_tz_watch_open();
+    if (tz_thread_fd < 0) {
+        close(tz_stop_fd);
+        tz_stop_fd = -1;
+        return -1;
+    }
+    if (pthread_create(&tz_thread, NULL, tz_watch_thread, NULL) != 0) {
+        fprintf(stderr, "Warning: Failed to start timezone watch thread\n");
+        tod_tz_watch_close(tz_thread_fd);
+        close(tz_stop_fd);
+        tz_thread_fd = tz_stop_fd = -1;
+        return -1;
+    }
+    tz_thread_started = 1;
+    return 0;
+}
+
+void tod_stop_tz_watch(void) {
+    if (tz_thread_started) {
+        uint64_t one = 1;
+        if (write(tz_stop_fd, &one, sizeof(one)) < 0) {
+            perror("Error stopping timezone watch thread");
+        }
+        pthread_join(tz_thread, NULL);
+        tz_thread_started = 0;
+        tod_tz_watch_close(tz_thread_fd);
+        close(tz_stop_fd);
+        tz_thread_fd = tz_stop_fd = -1;
+    }
+}
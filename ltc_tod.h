@@ -0,0 +1,40 @@
+#ifndef LTC_TOD_H
+#define LTC_TOD_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+
+#define TOD_SECONDS_PER_DAY 86400
+#define TOD_TZ_FILE "/etc/localtime"
+
+// Cached local-day anchor. Within [valid_from_s, valid_until_s) the UTC
+// offset is constant, so the local time of day is plain integer arithmetic
+// on the UTC time. The window ends at local midnight or at the next UTC
+// offset change (DST), whichever comes first. Each thread keeps its own.
+typedef struct {
+    int64_t valid_from_s;
+    int64_t valid_until_s;
+    int64_t day_start_s;      // UTC time at which the local day began (for this offset)
+    int years;
+    int months;
+    int days;
+    unsigned int tz_generation;
+} tod_anchor_t;
+
+// Split a UTC time in seconds into local date and H:M:S, rebuilding the
+// anchor with localtime_r only when the time leaves the cached window
+void tod_split(tod_anchor_t *anchor, int64_t time_s, SMPTETimecode *tc);
+
+// Watch the timezone file with inotify so that anchors are rebuilt when the
+// zone changes. tod_tz_watch_open returns the inotify descriptor for an
+// event loop to poll, or -1; tod_tz_watch_read handles it once readable.
+int tod_tz_watch_open(void);
+void tod_tz_watch_read(int fd);
+void tod_tz_watch_close(int fd);
+
+// Or watch from an idle-priority thread of its own, kept off cpu_core and
+// asleep until the zone changes. Returns 0 on success.
+int tod_start_tz_watch(int cpu_core);
+void tod_stop_tz_watch(void);
+
+#endif // LTC_TOD_H
@@ -0,0 +1,29 @@
+#include "ltc_usage.h"
+#include <string.h>
+
+static double timeval_s(const struct timeval *tv) {
+    return (double)tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static double cpu_s(const struct rusage *ru) {
+    return timeval_s(&ru->ru_utime) + timeval_s(&ru->ru_stime);
+}
+
+void usage_sample(usage_sample_t *s) {
+    clock_gettime(CLOCK_MONOTONIC, &s->wall);
+    getrusage(RUSAGE_THREAD, &s->thread);
+    getrusage(RUSAGE_SELF, &s->process);
+}
+
+void usage_compare(const usage_sample_t *start, const usage_sample_t *end, usage_report_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->seconds = (double)(end->wall.tv_sec - start->wall.tv_sec) +
+                 (end->wall.tv_nsec - start->wall.tv_nsec) / 1e9;
+    if (r->seconds <= 0.0) {
+        return;
+    }
+    r->thread_cpu_pct = 100.0 * (cpu_s(&end->thread) - cpu_s(&start->thread)) / r->seconds;
+    r->process_cpu_pct = 100.0 * (cpu_s(&end->process) - cpu_s(&start->process)) / r->seconds;
+    r->thread_wakeups_per_s = (end->thread.ru_nvcsw - start->thread.ru_nvcsw) / r->seconds;
+    r->thread_preemptions_per_s = (end->thread.ru_nivcsw - start->thread.ru_nivcsw) / r->seconds;
+}
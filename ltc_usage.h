@@ -0,0 +1,27 @@
+#ifndef LTC_USAGE_H
+#define LTC_USAGE_H
+
+#include <time.h>
+#include <sys/resource.h>
+
+// Resource usage of the calling thread and of the whole process at one
+// instant. Two samples taken on the same thread give its CPU load and how
+// often it was woken in between.
+typedef struct {
+    struct timespec wall;          // CLOCK_MONOTONIC
+    struct rusage thread;
+    struct rusage process;
+} usage_sample_t;
+
+typedef struct {
+    double seconds;
+    double thread_cpu_pct;         // Of one core
+    double process_cpu_pct;
+    double thread_wakeups_per_s;   // Voluntary context switches: sleeps ended by a wakeup
+    double thread_preemptions_per_s;
+} usage_report_t;
+
+void usage_sample(usage_sample_t *s);
+void usage_compare(const usage_sample_t *start, const usage_sample_t *end, usage_report_t *r);
+
+#endif // LTC_USAGE_H
@@ -0,0 +1,58 @@
+#include "ltc_xrun.h"
+#include "ltc_ntp.h"
+#include "ltc_correction.h"
+#include <string.h>
+#include <time.h>
+
+void xrun_detected(xrun_state_t *x) {
+    if (x->pending) {
+        return;
+    }
+    x->count++;
+    x->pending = 1;
+    x->detected_us = monotonic_now_us();
+}
+
+int xrun_resume(xrun_state_t *x, output_t *out, const rate_plan_t *plan, void *scratch, int *frame) {
+    // When the next sample will be heard, on the same time scale the frame
+    // labels are taken from (NTP offset and adaptive correction applied).
+    // The buffer was just emptied, so the delay is only what is still queued.
+    struct timespec ts;
+    int64_t delay_us;
+    output_measure(out, &ts, &delay_us);
+    int64_t out_us = (int64_t)ts.tv_sec * MICROSECONDS_PER_SECOND + ts.tv_nsec / NANOSECONDS_PER_MICROSECOND +
+                     delay_us + correction_lookup(&correction_table, ts.tv_nsec);
+    if (use_ntp) {
+        out_us += ntp_correction_now(&x->correction);
+    }
+
+    // At most a frame of silence, normally below the start threshold, so
+    // the stream starts with the frame that follows it
+    int64_t boundary_us = frame_boundary_after(plan, out_us, frame);
+    int silence = (int)(((boundary_us - out_us) * out->rate + MICROSECONDS_PER_SECOND - 1) / MICROSECONDS_PER_SECOND);
+
+    if (silence > 0) {
+        void *dst = scratch;
+        int err = output_begin(out, silence, &dst);
+        if (err < 0) {
+            return err;
+        }
+        // All zero bits is silence in every supported format, float included
+        memset(dst, 0, (size_t)silence * out->format->bytes);
+        err = output_commit(out, dst, silence);
+        if (err < 0) {
+            return err;
+        }
+        silence = err;
+    }
+
+    int64_t recovery_us = monotonic_now_us() - x->detected_us + delay_us + (boundary_us - out_us);
+    x->last_us = recovery_us;
+    if (recovery_us > x->max_us) {
+        x->max_us = recovery_us;
+    }
+    x->total_us += recovery_us;
+    x->silence_samples += (uint64_t)silence;
+    x->pending = 0;
+    return silence;
+}
@@ -0,0 +1,35 @@
+#ifndef LTC_XRUN_H
+#define LTC_XRUN_H
+
+#include <stdint.h>
+#include "ltc_common.h"
+#include "ltc_output.h"
+#include "ltc_discipline.h"
+
+// Output underrun (xrun) recovery. After the stream is prepared again the
+// buffer is empty, so the next frame would start wherever the clock happens
+// to be. Recovery instead queues silence up to the next frame boundary,
+// then the timecode source re-anchors on that boundary, so the first LTC
+// frame after the gap starts on time and carries the right label.
+typedef struct {
+    unsigned long count;           // Output errors recovered from
+    int pending;                   // Recovered, silence not yet queued
+    int64_t detected_us;           // CLOCK_MONOTONIC when the current xrun was seen
+    int64_t last_us;               // Recovery time: detection until the first
+    int64_t max_us;                // resumed frame is heard
+    int64_t total_us;
+    uint64_t silence_samples;      // Silence queued to reach frame boundaries
+    clock_correction_t correction; // Last consistent NTP snapshot, for the audio thread
+} xrun_state_t;
+
+// An output call failed; start timing the recovery. Repeated failures before
+// the stream resumes count as one xrun.
+void xrun_detected(xrun_state_t *x);
+
+// Queue silence, using scratch (at least one frame long) when the output
+// does not hand out device memory, so the next sample written starts a
+// frame. Returns the silence length in samples and the frame's index within
+// its second in *frame, or a negative output error.
+int xrun_resume(xrun_state_t *x, output_t *out, const rate_plan_t *plan, void *scratch, int *frame);
+
+#endif // LTC_XRUN_H